@@ -0,0 +1,480 @@
+// terminal_bench: headless throughput benchmark for the terminal core.
+//
+// Replays VT streams through Terminal::Feed and a Terminal::Render frame into an
+// ImGui draw list (no SDL, no GPU), the same path RenderTerminal drives in the
+// app, and reports MB/s, ns/byte, heap allocations per MB and the slowest frame
+// for each input. Parsing runs on the terminal's own thread, so the time covers
+// feeding until the last byte is parsed and drawn.
+// --parser-only feeds a bare libvterm parser instead, to isolate the scanner.
+// --check-replay records each input instead, replays the recording from the
+// start and from its end, and fails unless both show the live screen.
+//
+// Usage: terminal_bench [--mb N] [--frame-kb N] [--no-render] [--parser-only] [--check-replay] [--fixtures DIR] [case...]
+// Cases: ascii sgr tui cjk vttest (default: all)
+
+#include "imgui.h"
+#include "SessionRecording.h"
+#include "Terminal.h"
+#include "vterm.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef SHADOWSSH_VTTEST_DIR
+#define SHADOWSSH_VTTEST_DIR "src/terminal/libvterm/t"
+#endif
+
+// Count C++ heap allocations. libvterm's own mallocs are not included; it
+// allocates once per Terminal, outside the timed loop.
+static std::atomic<size_t> g_allocs{0};
+
+void* operator new(size_t size) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+constexpr size_t kFeedChunk = 64u << 10;
+
+struct Options {
+    size_t bytes = 16u << 20;
+    size_t frame_bytes = 256u << 10;
+    bool render = true;
+    bool parser_only = false;
+    bool check_replay = false;
+    std::string fixtures = SHADOWSSH_VTTEST_DIR;
+    std::vector<std::string> cases;
+};
+
+void append_utf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += (char)cp;
+    } else if (cp < 0x800) {
+        out += (char)(0xC0 | (cp >> 6));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += (char)(0xE0 | (cp >> 12));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else {
+        out += (char)(0xF0 | (cp >> 18));
+        out += (char)(0x80 | ((cp >> 12) & 0x3F));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+// `cat` of a plain log: printable ASCII lines of varying length.
+std::string gen_ascii(size_t target) {
+    std::mt19937 rng(1);
+    std::string out;
+    out.reserve(target + 256);
+    while (out.size() < target) {
+        int len = 20 + rng() % 100;
+        for (int i = 0; i < len; ++i) out += (char)(' ' + rng() % 95);
+        out += "\r\n";
+    }
+    return out;
+}
+
+// Compiler/ls-style output: short words, each with its own SGR.
+std::string gen_sgr(size_t target) {
+    std::mt19937 rng(2);
+    std::string out;
+    out.reserve(target + 256);
+    char sgr[48];
+    while (out.size() < target) {
+        int words = 4 + rng() % 12;
+        for (int w = 0; w < words; ++w) {
+            switch (rng() % 5) {
+            case 0: snprintf(sgr, sizeof(sgr), "\x1b[%dm", 30 + (int)(rng() % 8)); break;
+            case 1: snprintf(sgr, sizeof(sgr), "\x1b[1;%dm", 90 + (int)(rng() % 8)); break;
+            case 2: snprintf(sgr, sizeof(sgr), "\x1b[38;5;%dm", (int)(rng() % 256)); break;
+            case 3: snprintf(sgr, sizeof(sgr), "\x1b[38;2;%d;%d;%dm", (int)(rng() % 256), (int)(rng() % 256), (int)(rng() % 256)); break;
+            default: snprintf(sgr, sizeof(sgr), "\x1b[4;7;4%dm", (int)(rng() % 8)); break;
+            }
+            out += sgr;
+            int len = 2 + rng() % 10;
+            for (int i = 0; i < len; ++i) out += (char)('a' + rng() % 26);
+            out += "\x1b[0m ";
+        }
+        out += "\r\n";
+    }
+    return out;
+}
+
+// htop/vim-style full-screen redraws: absolute positioning, colored cells, erase to EOL.
+std::string gen_tui(size_t target, int cols, int rows) {
+    std::mt19937 rng(3);
+    std::string out;
+    out.reserve(target + 4096);
+    char seq[48];
+    while (out.size() < target) {
+        out += "\x1b[?25l\x1b[H";
+        for (int r = 1; r <= rows; ++r) {
+            snprintf(seq, sizeof(seq), "\x1b[%d;1H", r);
+            out += seq;
+            if (r == 1 || r == rows) {
+                out += "\x1b[7m";
+                for (int c = 0; c < cols; ++c) out += (char)('A' + (r + c) % 26);
+                out += "\x1b[0m";
+                continue;
+            }
+            int col = 0;
+            while (col < cols - 12) {
+                snprintf(seq, sizeof(seq), "\x1b[%d;%dm", 30 + (int)(rng() % 8), 40 + (int)(rng() % 8));
+                out += seq;
+                int len = 1 + rng() % 10;
+                for (int i = 0; i < len; ++i) out += (char)('0' + rng() % 10);
+                col += len;
+            }
+            out += "\x1b[0m\x1b[K";
+        }
+        out += "\x1b[?25h";
+    }
+    return out;
+}
+
+// CJK prose with ASCII and the occasional emoji: wide cells and multi-byte UTF-8.
+std::string gen_cjk(size_t target) {
+    std::mt19937 rng(4);
+    std::string out;
+    out.reserve(target + 256);
+    while (out.size() < target) {
+        int len = 10 + rng() % 50;
+        for (int i = 0; i < len; ++i) {
+            unsigned k = rng() % 16;
+            if (k < 11) append_utf8(out, 0x4E00 + rng() % 0x5000);
+            else if (k < 15) out += (char)('a' + rng() % 26);
+            else append_utf8(out, 0x1F600 + rng() % 0x40);
+        }
+        out += "\r\n";
+    }
+    return out;
+}
+
+// Decode the double-quoted Perl string of a PUSH line in a libvterm test script.
+bool parse_push(const std::string& line, std::string& out) {
+    size_t open = line.find('"');
+    if (open == std::string::npos) return false;
+    for (size_t i = open + 1; i < line.size(); ++i) {
+        char c = line[i];
+        if (c == '"') return true;
+        if (c != '\\' || i + 1 >= line.size()) {
+            out += c;
+            continue;
+        }
+        char e = line[++i];
+        switch (e) {
+        case 'e': out += '\x1b'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'b': out += '\b'; break;
+        case 'a': out += '\a'; break;
+        case '0': out += '\0'; break;
+        case 'x': {
+            uint32_t cp = 0;
+            if (i + 1 < line.size() && line[i + 1] == '{') {
+                size_t close = line.find('}', i);
+                cp = (uint32_t)strtoul(line.substr(i + 2, close - i - 2).c_str(), nullptr, 16);
+                i = close;
+                append_utf8(out, cp);
+            } else {
+                cp = (uint32_t)strtoul(line.substr(i + 1, 2).c_str(), nullptr, 16);
+                i += 2;
+                out += (char)cp;
+            }
+            break;
+        }
+        default: out += e; break;   // \\, \", \#
+        }
+    }
+    return false;
+}
+
+// Concatenate the PUSH data of every t/90vttest_* script, with a reset between
+// them, following the $REP and $SEQ expansions of run-test.pl.
+std::string load_vttest(const std::string& dir) {
+    std::vector<std::filesystem::path> files;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("90vttest_", 0) == 0 && entry.path().extension() == ".test") files.push_back(entry.path());
+    }
+    std::sort(files.begin(), files.end());
+
+    std::string out;
+    for (const auto& path : files) {
+        out += "\x1b" "c";
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line)) {
+            size_t start = line.find_first_not_of(" \t");
+            if (start == std::string::npos) continue;
+            line.erase(0, start);
+            int low = 0, high = 0, reps = 1;
+            bool seq = false;
+            if (sscanf(line.c_str(), "$REP %d:", &reps) == 1) {
+                line.erase(0, line.find(':') + 1);
+            } else if (sscanf(line.c_str(), "$SEQ %d %d:", &low, &high) == 2) {
+                line.erase(0, line.find(':') + 1);
+                seq = true;
+            }
+            start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line.compare(start, 5, "PUSH ") != 0) continue;
+            line.erase(0, start);
+            if (seq) {
+                for (int v = low; v <= high; ++v) {
+                    std::string expanded = line;
+                    for (size_t p; (p = expanded.find("\\#")) != std::string::npos;) expanded.replace(p, 2, std::to_string(v));
+                    parse_push(expanded, out);
+                }
+            } else {
+                std::string bytes;
+                parse_push(line, bytes);
+                for (int r = 0; r < reps; ++r) out += bytes;
+            }
+        }
+    }
+    return out;
+}
+
+// Repeat `unit` up to roughly `target` bytes.
+std::string repeat_to(const std::string& unit, size_t target) {
+    std::string out;
+    if (unit.empty()) return out;
+    out.reserve(target + unit.size());
+    while (out.size() < target) out += unit;
+    return out;
+}
+
+// Mark textures as uploaded, standing in for a renderer backend.
+void fake_texture_uploads() {
+    for (ImTextureData* tex : ImGui::GetPlatformIO().Textures) {
+        if (tex->Status == ImTextureStatus_WantCreate || tex->Status == ImTextureStatus_WantUpdates) {
+            tex->SetTexID((ImTextureID)1);
+            tex->SetStatus(ImTextureStatus_OK);
+        } else if (tex->Status == ImTextureStatus_WantDestroy) {
+            tex->SetTexID(ImTextureID_Invalid);
+            tex->SetStatus(ImTextureStatus_Destroyed);
+        }
+    }
+}
+
+void render_frame(Terminal& term) {
+    ImGuiIO& io = ImGui::GetIO();
+    io.DeltaTime = 1.0f / 60.0f;
+    ImGui::NewFrame();
+    ImGui::SetNextWindowPos(ImVec2(0, 0));
+    ImGui::SetNextWindowSize(io.DisplaySize);
+    ImGui::Begin("Terminal", nullptr, ImGuiWindowFlags_NoDecoration);
+    term.Render();
+    ImGui::End();
+    ImGui::Render();
+    fake_texture_uploads();
+}
+
+// Parser callbacks that accept everything; text spans arrive already bounded
+// by control bytes, so the callback just takes the whole span.
+int parse_text(const char[], size_t len, void*) { return (int)len; }
+int parse_control(unsigned char, void*) { return 1; }
+int parse_escape(const char[], size_t, void*) { return 1; }
+int parse_csi(const char*, const long[], int, const char*, char, void*) { return 1; }
+int parse_osc(int, VTermStringFragment, void*) { return 1; }
+int parse_dcs(const char*, size_t, VTermStringFragment, void*) { return 1; }
+
+double parse_only(const std::string& data, int cols, int rows) {
+    VTermParserCallbacks callbacks{};
+    callbacks.text = parse_text;
+    callbacks.control = parse_control;
+    callbacks.escape = parse_escape;
+    callbacks.csi = parse_csi;
+    callbacks.osc = parse_osc;
+    callbacks.dcs = parse_dcs;
+    VTerm* vt = vterm_new(rows, cols);
+    vterm_set_utf8(vt, 1);
+    vterm_parser_set_callbacks(vt, &callbacks, nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t off = 0; off < data.size(); off += kFeedChunk)
+        vterm_input_write(vt, data.data() + off, std::min(kFeedChunk, data.size() - off));
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    vterm_free(vt);
+    return secs;
+}
+
+void play_to_end(SessionPlayer& player, Terminal& term) {
+    while (!player.AtEnd()) {
+        player.Advance(term, 0.0);
+        std::this_thread::yield();
+    }
+    player.Advance(term, 0.0);  // a keyframe with no output after it
+    term.Sync();
+}
+
+// Output from before recording starts reaches a replay only through the first keyframe.
+bool check_replay(const char* name, const std::string& data, int cols, int rows) {
+    std::string path = (std::filesystem::temp_directory_path() / "terminal_bench.shrec").string();
+    Terminal live(cols, rows);
+    live.SetFixedSize(cols, rows);
+    live.Feed("before recording$ ");
+    live.Sync();
+    if (!live.StartRecording(path)) {
+        printf("%-8s  cannot create %s\n", name, path.c_str());
+        return false;
+    }
+    for (size_t off = 0; off < data.size();) {
+        size_t n = live.Feed(data.data() + off, std::min(kFeedChunk, data.size() - off));
+        if (n == 0) std::this_thread::yield();
+        off += n;
+    }
+    live.Sync();
+    bool recorded = live.RecordingOk();
+    std::string want = live.ScreenText();
+    live.StopRecording();
+    live.Sync();
+
+    SessionPlayer player;
+    bool ok = recorded && player.Open(path);
+    Terminal replay(cols, rows);
+    player.SetSpeed(0.0);
+    if (ok) {
+        player.Seek(replay, 0.0);
+        play_to_end(player, replay);
+        ok = replay.ScreenText() == want;
+    }
+    bool ok_end = false;
+    if (ok) {
+        player.Seek(replay, player.Duration());
+        play_to_end(player, replay);
+        ok_end = replay.ScreenText() == want;
+    }
+    player.Close();
+    std::filesystem::remove(path);
+    printf("%-8s  replay from start %s, from end %s\n", name, !recorded ? "not recorded" : ok ? "ok" : "MISMATCH",
+           !ok ? "-" : ok_end ? "ok" : "MISMATCH");
+    return ok && ok_end;
+}
+
+void run_case(const char* name, const std::string& data, int cols, int rows, const Options& opt) {
+    if (data.empty()) {
+        printf("%-8s  (no input)\n", name);
+        return;
+    }
+    if (opt.parser_only) {
+        double secs = parse_only(data, cols, rows);
+        double mb = data.size() / double(1 << 20);
+        printf("%-8s %8.1f %10.2f %10.1f %11s %9s\n", name, mb, mb / secs, secs * 1e9 / data.size(), "-", "-");
+        return;
+    }
+    Terminal term(cols, rows);
+    // Pinned, so the frames do not fit the grid to the display instead.
+    term.SetFixedSize(cols, rows);
+    // Font atlas and window setup stay out of the numbers.
+    if (opt.render) render_frame(term);
+    term.Sync();
+
+    size_t allocs = g_allocs.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    double worst_frame = 0.0;
+    auto timed_frame = [&] {
+        auto frame_start = std::chrono::steady_clock::now();
+        render_frame(term);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count();
+        worst_frame = std::max(worst_frame, ms);
+    };
+    size_t since_frame = 0;
+    for (size_t off = 0; off < data.size();) {
+        size_t n = term.Feed(data.data() + off, std::min(kFeedChunk, data.size() - off));
+        if (n == 0) std::this_thread::yield();  // input buffer full; the parser is behind
+        off += n;
+        since_frame += n;
+        if (opt.render && since_frame >= opt.frame_bytes) {
+            timed_frame();
+            since_frame = 0;
+        }
+    }
+    term.Sync();
+    if (opt.render) timed_frame();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    allocs = g_allocs.load(std::memory_order_relaxed) - allocs;
+
+    double mb = data.size() / double(1 << 20);
+    printf("%-8s %8.1f %10.2f %10.1f %11.1f %9.2f\n", name, mb, mb / secs, secs * 1e9 / data.size(), allocs / mb,
+           worst_frame);
+}
+
+bool wants(const Options& opt, const char* name) {
+    if (opt.cases.empty()) return true;
+    for (const auto& c : opt.cases)
+        if (c == name) return true;
+    return false;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--mb" && i + 1 < argc) {
+            opt.bytes = (size_t)(atof(argv[++i]) * (1 << 20));
+        } else if (arg == "--frame-kb" && i + 1 < argc) {
+            opt.frame_bytes = (size_t)atoi(argv[++i]) << 10;
+        } else if (arg == "--no-render") {
+            opt.render = false;
+        } else if (arg == "--parser-only") {
+            opt.parser_only = true;
+        } else if (arg == "--check-replay") {
+            opt.check_replay = true;
+        } else if (arg == "--fixtures" && i + 1 < argc) {
+            opt.fixtures = argv[++i];
+        } else if (arg[0] == '-') {
+            printf("usage: %s [--mb N] [--frame-kb N] [--no-render] [--parser-only] [--check-replay] [--fixtures DIR] [ascii|sgr|tui|cjk|vttest...]\n", argv[0]);
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        } else {
+            opt.cases.push_back(arg);
+        }
+    }
+
+    ImGui::CreateContext();
+    ImGuiIO& io = ImGui::GetIO();
+    io.IniFilename = nullptr;
+    io.DisplaySize = ImVec2(1280, 800);
+    io.BackendFlags |= ImGuiBackendFlags_RendererHasTextures;
+    io.Fonts->AddFontDefault();
+
+    bool failed = false;
+    auto run = [&](const char* name, const std::string& data, int cols, int rows) {
+        if (opt.check_replay) failed |= !check_replay(name, data, cols, rows);
+        else run_case(name, data, cols, rows, opt);
+    };
+    if (opt.check_replay)
+        failed |= !check_replay("short", "hello\r\n", 80, 25);  // the screen from before recording stays in view
+    else
+        printf("%-8s %8s %10s %10s %11s %9s\n", "case", "MB", "MB/s", "ns/byte", "allocs/MB", "frame ms");
+    if (wants(opt, "ascii")) run("ascii", gen_ascii(opt.bytes), 120, 40);
+    if (wants(opt, "sgr")) run("sgr", gen_sgr(opt.bytes), 120, 40);
+    if (wants(opt, "tui")) run("tui", gen_tui(opt.bytes, 120, 40), 120, 40);
+    if (wants(opt, "cjk")) run("cjk", gen_cjk(opt.bytes), 120, 40);
+    // The fixtures are written for libvterm's 25x80 test screen.
+    if (wants(opt, "vttest")) run("vttest", repeat_to(load_vttest(opt.fixtures), opt.bytes), 80, 25);
+
+    ImGui::DestroyContext();
+    return failed ? 1 : 0;
+}
@@ -7,6 +7,10 @@
 #include "SystemMonitor.h" // Added
 #include "EditorManager.h" // Added
 #include "Terminal.h"
+#include "SessionRecording.h"
+#include "TmuxControl.h"
+#include <atomic>
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -30,6 +34,17 @@ private:
     SDL_Renderer* renderer = nullptr;
     bool running = true;
 
+    // Idle handling: Run sleeps until SDL input, a wake event posted by an I/O
+    // thread, or the cursor blink timer, then renders a few frames to settle.
+    Uint32 wake_event = (Uint32)-1;
+    std::atomic<bool> wake_pending{false};
+    SDL_TimerID blink_timer = 0;
+    int frames_to_render = 0;
+    void PostWake();
+    void UpdateBlinkTimer();
+    void HandleEvent(const SDL_Event& event);
+    static Uint32 BlinkTimerCallback(Uint32 interval, void* param);
+
     // Logic
     AppState state = AppState::LOGIN;
     SSHClient sshClient;
@@ -61,6 +76,19 @@ private:
     // Terminal State
     Terminal terminal;
     bool shell_ready = false;
+    // tmux -CC on the shell: its panes replace the terminal while attached
+    TmuxControl tmux;
+
+    // Recording replay, in its own window and terminal
+    SessionPlayer player;
+    std::unique_ptr<Terminal> replay_terminal;
+    float replay_scrub = -1.0f;     // slider position while dragging
+
+    // Highlight rules, edited as the text of their file
+    std::string highlights_path;
+    char highlights_text[8192] = "";
+    std::string highlights_errors;
+    bool highlights_open = false;
 
     // Helpers
     void ApplyDarkTheme();
@@ -69,12 +97,18 @@ private:
     void RenderFileBrowser();
     void RenderEditor();
     void RenderTerminal();
+    void RenderReplay();
+    void RenderTmuxPanes();
+    void RenderHighlightRules();
     void RenderMonitor(); // Added
     
     void RefreshFileList();
     void OpenFile(const std::string& filename);
     void SaveFile();
     void LaunchNativeTerminal();
+    void StartRecording();
+    void OpenReplay();
+    void ApplyHighlightRules(bool save);
 
     // State for external terminal
     bool terminal_launched = false;
@@ -0,0 +1,38 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Single-producer/single-consumer byte ring. The producer writes straight into
+// WriteSpan() and publishes with Commit(); the consumer reads in place through
+// ReadSpan() and releases with Consume(). Spans never wrap, so a full transfer
+// may take two calls. No locks and no allocation after construction.
+class ByteRing {
+public:
+    static constexpr size_t kDefaultCapacity = 4u << 20;
+
+    // Capacity is rounded up to a power of two.
+    explicit ByteRing(size_t capacity = kDefaultCapacity);
+
+    // Producer side.
+    size_t WriteSpan(char** out);
+    void Commit(size_t n);
+
+    // Consumer side.
+    size_t ReadSpan(const char** out) const;
+    void Consume(size_t n);
+
+    size_t Size() const;
+    bool Empty() const { return Size() == 0; }
+    size_t Capacity() const { return mask + 1; }
+
+    // Drop all data. Only valid while neither side is active.
+    void Reset();
+
+private:
+    std::unique_ptr<char[]> buf;
+    size_t mask = 0;
+    // Free-running counters; each side owns one and only reads the other.
+    alignas(64) std::atomic<size_t> head{0};    // bytes written
+    alignas(64) std::atomic<size_t> tail{0};    // bytes consumed
+};
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// ColdStore is the disk tier behind Scrollback. Lines evicted from the memory
+// ring are appended as opaque byte records, grouped into blocks, compressed,
+// and written to a scratch file under the temp directory that is read back
+// through a memory map. A small block index maps line numbers to file offsets,
+// so resident memory stays bounded by one open block plus per-thread caches.
+class ColdStore {
+public:
+    static constexpr size_t kBlockBytes = 256u << 10;
+
+    ColdStore();
+    ~ColdStore();
+    ColdStore(const ColdStore&) = delete;
+    ColdStore& operator=(const ColdStore&) = delete;
+
+    // False once the scratch file could not be created or written.
+    bool Ok() const { return ok; }
+
+    void Append(const uint8_t* record, size_t bytes);
+    size_t Size() const { return lines; }
+    // Bytes of the line's record. Valid until the calling thread reads lines
+    // from two other blocks, or until the store is modified.
+    const uint8_t* Line(size_t index) const;
+    void Clear();
+
+    uint64_t DiskBytes() const { return file_size; }
+
+private:
+    struct Block {
+        uint64_t offset;        // in the scratch file
+        uint32_t packed_bytes;
+        uint32_t raw_bytes;
+        size_t first_line;
+        uint32_t lines;
+    };
+
+    bool ok = true;
+    intptr_t file = -1;
+    const uint8_t* view = nullptr;
+    uint64_t file_size = 0;
+    uint64_t id;                        // distinguishes stores in the per-thread caches
+    uint64_t generation = 0;            // bumped by Clear
+
+    std::vector<Block> blocks;
+    size_t lines = 0;
+
+    // Lines not yet written out: records back to back, with their offsets.
+    std::vector<uint8_t> open_block;
+    std::vector<uint32_t> open_offsets;
+    size_t open_first = 0;
+
+    bool flush();
+    void release();
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+// CommandIndex records shell-integration marks (OSC 133) by line: for each
+// command, where its prompt (A), typed command line (B) and output (C) begin and
+// where its end mark (D) came, with the exit status. Lines are absolute, numbered
+// as Scrollback numbers them and continuing down the screen, so entries follow
+// output as it scrolls and lookups never read scrollback text. Entries are kept
+// in line order; a prompt at or above an earlier one (the screen was cleared or
+// redrawn) drops the entries it replaces.
+class CommandIndex {
+public:
+    static constexpr uint64_t kNoLine = ~0ull;
+
+    struct Entry {
+        uint64_t prompt = kNoLine;
+        uint64_t input = kNoLine;
+        uint64_t output = kNoLine;
+        uint64_t end = kNoLine;     // one past the last output line
+        int exit_code = -1;         // -1 when D carried none
+    };
+
+    // One OSC 133 mark: `kind` is 'A', 'B', 'C' or 'D', at the cursor's line and column.
+    void Mark(char kind, uint64_t line, int col, int exit_code = -1);
+    void Clear() { entries.clear(); }
+    // Forget entries whose prompt is before `first_line`, e.g. evicted history.
+    void Trim(uint64_t first_line);
+    // Renumber every line through `map` after lines moved; an entry whose prompt
+    // maps to kNoLine, or out of order, is dropped.
+    void Remap(const std::function<uint64_t(uint64_t)>& map);
+
+    size_t Size() const { return entries.size(); }
+    const Entry& operator[](size_t i) const { return entries[i]; }
+    // Output lines of entry `i` as [begin, end). A command still running ends at
+    // kNoLine. False if no output mark was seen.
+    bool Output(size_t i, uint64_t& begin, uint64_t& end) const;
+    // The newest entry with output, i.e. the last command run; false if none.
+    bool LastWithOutput(size_t& i) const;
+    // Entries whose prompt is before / after `line`; false if none.
+    bool Before(uint64_t line, size_t& i) const;
+    bool After(uint64_t line, size_t& i) const;
+
+private:
+    std::deque<Entry> entries;
+};
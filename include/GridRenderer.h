@@ -0,0 +1,63 @@
+#pragma once
+#include "imgui.h"
+#include "TerminalStructs.h"
+#include <vector>
+
+struct ImFontBaked;
+
+// GridRenderer draws terminal rows straight into an ImDrawList on a fixed cell
+// grid. Glyph quads for ASCII are looked up once per font/atlas change, so a row
+// costs one vertex reservation and no text layout or string building. Rows drawn
+// through DrawRowCached keep their vertices, so a frame in which one row changed
+// rebuilds that row and copies the rest.
+class GridRenderer {
+public:
+    // Refresh cell metrics for the current ImGui font. Call once per frame.
+    void BeginFrame();
+
+    float CellWidth() const { return cell_w; }
+    float CellHeight() const { return cell_h; }
+
+    // Draw one row of `count` cells with its top-left corner at `pos`.
+    void DrawRow(ImDrawList* dl, ImVec2 pos, const TermCell* cells, int count);
+
+    // DrawRow through the row cache. `key` identifies the row's contents (0 never
+    // hits) and `slot` its cache entry, e.g. its absolute line number. A hit at the
+    // same position is a plain copy; a row that scrolled is copied and shifted.
+    void DrawRowCached(ImDrawList* dl, ImVec2 pos, const TermCell* cells, int count, uint64_t key, uint64_t slot);
+    // Entries for at least `rows` rows; slots map onto them modulo the size.
+    void ReserveRowCache(int rows);
+
+private:
+    struct Glyph {
+        float x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+        float u0 = 0, v0 = 0, u1 = 0, v1 = 0;
+        bool visible = false;
+    };
+
+    ImFontBaked* baked = nullptr;
+    float scale = 1.0f;
+    float cell_w = 0.0f;
+    float cell_h = 0.0f;
+    float underline_y = 0.0f;
+
+    // ASCII glyphs by value; valid while the atlas texture keeps its layout.
+    Glyph ascii[128];
+    int atlas_tex_id = -1;
+    ImVec2 atlas_uv_scale;
+
+    // A row's vertices as last built, at `origin`; indices count from its first vertex.
+    struct CachedRow {
+        uint64_t key = 0;
+        uint64_t epoch = 0;
+        ImVec2 origin;
+        std::vector<ImDrawVert> vtx;
+        std::vector<ImDrawIdx> idx;
+    };
+    std::vector<CachedRow> row_cache;
+    uint64_t epoch = 1;     // bumped when metrics or the atlas change, voiding cached rows
+
+    bool atlas_changed() const;
+    void refresh_ascii();
+    Glyph lookup(uint32_t codepoint);
+};
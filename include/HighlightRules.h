@@ -0,0 +1,62 @@
+#pragma once
+#include "TerminalStructs.h"
+#include <cstdint>
+#include <regex>
+#include <string>
+#include <vector>
+
+// A user highlight: text to color in terminal output, like `grep --color`.
+struct HighlightRule {
+    std::string pattern;
+    bool regex = false;
+    uint32_t color = 0;         // packed RGBA, as TermCell colors
+};
+
+// HighlightRules colors matches in rows of cells as the parser finalizes them:
+// rows entering scrollback and screen rows that changed since the last snapshot.
+// The colors are written into the cells, so history keeps them in its attribute
+// runs and drawing never looks for matches. Literal patterns are compiled into
+// one Aho-Corasick automaton over UTF-8 bytes, with byte classes to keep the
+// transition table small; regex rules run after it. Matches do not span rows.
+class HighlightRules {
+public:
+    // The rules file: one "RRGGBB pattern" per line, a pattern in slashes is a
+    // regex, and lines starting with '#' are comments. Bad lines are skipped and
+    // described in `errors`.
+    static std::vector<HighlightRule> Parse(const std::string& text, std::string* errors = nullptr);
+
+    void Compile(const std::vector<HighlightRule>& rules);
+    bool Empty() const { return literals.empty() && regexes.empty(); }
+
+    // Color the matches in a row of `count` cells: the rule color, bold. Where
+    // matches overlap, the rule listed first wins.
+    void Apply(TermCell* cells, int count);
+
+private:
+    struct Literal {
+        uint32_t color;
+        int length;             // bytes
+        int rank;               // rule order; earlier rules win where matches overlap
+    };
+    struct Regex {
+        std::regex re;
+        uint32_t color;
+        int rank;
+    };
+
+    std::vector<Literal> literals;
+    std::vector<Regex> regexes;
+    uint16_t byte_class[256] = {};  // 0 for bytes in no pattern
+    int classes = 1;
+    std::vector<int32_t> next;      // state * classes + class -> state, failures folded in
+    std::vector<int32_t> output;    // literal ending at a state, -1 for none
+    std::vector<int32_t> suffix;    // nearest state on the failure chain with an output, 0 for none
+
+    // Scratch for Apply
+    std::string text;
+    std::vector<int> cell_of;       // text byte -> cell
+    std::vector<int> owner;         // rank of the rule that colored each cell
+    bool painted = false;
+
+    void paint(TermCell* cells, int count, size_t begin, size_t end, uint32_t color, int rank);
+};
@@ -0,0 +1,79 @@
+#pragma once
+#include "TerminalStructs.h"
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// LocalEcho guesses what the remote end will echo for the keys typed, in the
+// manner of mosh, so typing shows at once over a slow link. Printable characters,
+// Backspace and Left/Right are applied to a predicted cursor on the cursor row;
+// the cells they write are drawn underlined over the screen until a snapshot
+// agrees with them, and dropped as soon as one cannot. Predictions are only
+// shown once echoes take noticeably long, and are off in the alternate screen,
+// at password prompts, and after typed keys went unechoed until the next Enter.
+class LocalEcho {
+public:
+    // The screen as Render shows it; `row(r)` yields at least `cols` cells.
+    struct Screen {
+        int cols = 0;
+        int rows = 0;
+        int cursor_row = 0;
+        int cursor_col = 0;
+        bool altscreen = false;
+        uint64_t version = 0;    // changes with the cells
+        std::function<const TermCell*(int)> row;
+    };
+
+    // A predicted cell on Row().
+    struct Cell {
+        int col;
+        TermCell cell;
+    };
+
+    // Keys as they go upstream; `now` is in seconds.
+    void Char(const Screen& s, uint32_t ch, double now);
+    void Backspace(const Screen& s, double now);
+    void Move(const Screen& s, int delta, double now);
+    // Any other key: nothing more is predicted until the screen has reacted.
+    // Enter (`line_end`) also lifts a suspension from unechoed input.
+    void Barrier(const Screen& s, bool line_end, double now);
+    void Clear();
+
+    // Confirm or drop pending keys against the screen. Call once per frame.
+    void Reconcile(const Screen& s, double now);
+
+    bool Showing() const { return showing; }
+    int Row() const { return row; }
+    int CursorCol() const { return keys.empty() ? start_col : keys.back().cursor; }
+    const std::vector<Cell>& Cells() const { return overlay; }
+
+private:
+    struct Key {
+        int col;            // cell written, -1 for a cursor move
+        TermCell cell;
+        int cursor;         // predicted cursor column after the key
+        double sent;
+        bool typed = false; // a printable character
+    };
+
+    std::vector<Key> keys;
+    int row = 0;
+    int start_col = 0;          // cursor before the first pending key
+    double srtt = 0.0;          // smoothed echo delay, 0 until measured
+    bool suspended = false;     // typing went unechoed; off until Enter
+    bool echo_seen = false;     // a key on this line was confirmed
+    bool blocked = false;       // a barrier the screen has not reacted to yet
+    uint64_t blocked_version = 0;
+    int blocked_row = 0;
+    int blocked_col = 0;
+    double blocked_since = 0.0;
+    bool showing = false;
+    std::vector<Cell> overlay;
+
+    bool can_predict(const Screen& s);
+    void begin(const Screen& s);
+    void push(int col, const TermCell& cell, int cursor, double now);
+    bool matches(const Screen& s, size_t count) const;
+    double timeout() const;
+    void rebuild(double now);
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 // Cross-platform helpers. Implementations live under src/platform/.
@@ -17,6 +18,24 @@ std::string GetConfigDir();
 // Return a writable temp directory.
 std::string GetTempDir();
 
+// Scratch files for spilling data to disk. The file is created under GetTempDir(),
+// removed when closed, and read back through a read-only memory map.
+// OpenScratchFile returns -1 on failure; MapScratchFile returns nullptr.
+intptr_t OpenScratchFile(const std::string& prefix);
+bool AppendScratchFile(intptr_t file, const void* data, size_t size);
+const void* MapScratchFile(intptr_t file, size_t size);
+void UnmapScratchFile(const void* view, size_t size);
+void CloseScratchFile(intptr_t file);
+
+// Map an existing file read-only in full. Returns nullptr (size 0) if it is
+// missing, empty or cannot be mapped; release with UnmapFile.
+const void* MapFile(const std::string& path, size_t& size);
+void UnmapFile(const void* view, size_t size);
+
+// Block until `socket` has data to read or `timeout_ms` elapses.
+// Returns true when readable (or on error, so callers go on to read and notice it).
+bool WaitSocketReadable(intptr_t socket, int timeout_ms);
+
 // Show a native "open file" dialog. Returns absolute path or "" on cancel.
 std::string OpenFileDialog();
 
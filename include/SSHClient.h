@@ -6,6 +6,7 @@
 #include <thread>
 #include <mutex>
 #include "SSHStructs.h"
+#include "ByteRing.h"
 
 class SSHClient {
 public:
@@ -24,13 +25,20 @@ public:
     bool is_busy(); // Connection/Auth in progress
 
     // Shell
-    bool init_shell();
+    bool init_shell(int cols = 80, int rows = 24);
     void send_shell_command(const std::string& cmd);
-    std::string read_shell_output();
+    // Send a window-change request for the shell's PTY.
+    void resize_shell(int cols, int rows);
+    // Output drained by the shell reader thread. Consume from a single thread.
+    ByteRing& get_shell_output() { return shell_output; }
     
     // Sync Exec
     std::string exec_command_sync(const std::string& cmd);
 
+    // Called from worker and reader threads when connect/auth finishes or shell
+    // output arrives. Set before connecting; must be cheap and thread-safe.
+    void set_notify_callback(std::function<void()> cb);
+
     ssh_session get_session() { return my_session; }
     std::recursive_mutex& get_mutex() { return session_mutex; }
 
@@ -47,10 +55,23 @@ private:
     std::string last_error;
     std::mutex error_mutex;
 
+    std::mutex notify_mutex;
+    std::function<void()> notify_callback;
+    void notify();
+
     void set_error(const std::string& err);
     bool verify_known_host();
     void close_shell_channel();
     void join_worker();
 
     std::thread worker_thread;
+
+    // Shell reader: waits on the socket without the session lock and only takes
+    // it to drain the channel into shell_output.
+    ByteRing shell_output;
+    std::thread shell_reader;
+    std::atomic<bool> shell_reader_running{false};
+    void start_shell_reader();
+    void stop_shell_reader();
+    void shell_reader_loop();
 };
@@ -0,0 +1,105 @@
+#pragma once
+#include "TerminalStructs.h"
+#include "ColdStore.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Scrollback stores lines that scrolled off the top of the terminal in a fixed
+// byte arena used as a ring. Each line is packed as UTF-8 text plus run-length
+// attribute spans, trailing blanks are dropped, and the oldest lines are evicted
+// once the byte budget is exhausted. Push and pop never allocate.
+// With the cold tier enabled, evicted lines move to a compressed on-disk
+// ColdStore instead of being dropped; indices span both tiers transparently.
+class Scrollback {
+public:
+    static constexpr size_t kDefaultBudget = 64u << 20;
+    static constexpr size_t kMinBudget = 1u << 20;
+    // Once the cold tier's file reaches this size, its lines are dropped together.
+    static constexpr uint64_t kDefaultColdLimit = 1ull << 30;
+
+    explicit Scrollback(size_t budget_bytes = kDefaultBudget);
+
+    // Reallocate the ring for a new budget. Existing history is discarded.
+    void SetBudget(size_t budget_bytes);
+    size_t Budget() const { return budget; }
+    size_t BytesUsed() const;
+
+    // Spill evicted lines to disk. Disabling drops what was spilled.
+    void EnableColdTier(bool enable, uint64_t limit_bytes = kDefaultColdLimit);
+    uint64_t ColdBytes() const { return cold ? cold->DiskBytes() : 0; }
+
+    void Push(const TermCell* cells, int cols, bool continuation);
+    // Remove the most recent line, decoding it into `cells` (padded with `blank`).
+    // Lines already in the cold tier stay there.
+    bool PopBack(TermCell* cells, int cols, const TermCell& blank);
+    void Clear();
+    // Where a re-wrapped logical line started, by absolute index, before and after.
+    struct LineMove {
+        uint64_t from;
+        uint64_t to;
+    };
+    // Re-wrap the newest `max_lines` lines (extended back to a logical line start)
+    // to `cols`, joining rows marked as continuations. Older lines keep their width.
+    // `moves`, if given, receives each re-wrapped logical line in order.
+    void Reflow(int cols, size_t max_lines, const TermCell& blank, std::vector<LineMove>* moves = nullptr);
+
+    size_t Size() const { return cold_lines() + count; }
+    bool Empty() const { return Size() == 0; }
+    // Absolute number of the oldest retained line; grows as lines are evicted.
+    uint64_t FirstIndex() const { return evicted; }
+
+    // Accessors take an index relative to the oldest retained line. Text views of
+    // cold lines stay valid until the calling thread has read two other blocks.
+    std::string_view Text(size_t index) const;
+    int Cols(size_t index) const;
+    bool Continuation(size_t index) const;
+    void Decode(size_t index, std::vector<TermCell>& out, int width, const TermCell& blank) const;
+
+private:
+    struct Record {
+        uint16_t text_bytes;
+        uint16_t run_count;
+        uint16_t cols;
+        uint16_t flags;
+    };
+
+    struct Run {
+        uint16_t cells;
+        uint8_t flags;
+        uint8_t pad;
+        uint32_t fg;
+        uint32_t bg;
+    };
+
+    enum : uint8_t {
+        RunBold = 1 << 0,
+        RunUnderline = 1 << 1,
+        RunReverse = 1 << 2,
+        RunWide = 1 << 3,
+        RunDefaultFg = 1 << 4,
+        RunDefaultBg = 1 << 5,
+    };
+    enum : uint16_t { LineContinuation = 1 << 0 };
+
+    size_t budget = 0;
+    std::unique_ptr<uint8_t[]> arena;
+    size_t arena_size = 0;
+    std::unique_ptr<uint32_t[]> offsets;    // ring of record offsets into arena
+    size_t index_capacity = 0;
+    size_t tail = 0;                        // ring slot of the oldest line
+    size_t count = 0;
+    size_t head_off = 0;                    // next free byte in arena
+    uint64_t evicted = 0;
+
+    std::unique_ptr<ColdStore> cold;
+    uint64_t cold_limit = 0;
+
+    size_t cold_lines() const { return cold ? cold->Size() : 0; }
+    const Record* record(size_t index) const;
+    void decode_into(const Record* rec, TermCell* out, int width, const TermCell& blank) const;
+    size_t allocate(size_t bytes);
+    void evict_oldest();
+};
@@ -0,0 +1,121 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Terminal;
+
+// Session recordings: the terminal's output stream with timestamps, plus the
+// screen size and periodic keyframes at points in that stream.
+//
+// File layout: the 8-byte magic, then records of
+//   u8 type, varint microseconds since the previous record, payload
+// where the payload is
+//   Data:     varint length, bytes
+//   Resize:   varint stream offset, varint cols, varint rows
+//   Keyframe: varint stream offset, varint cols, varint rows, varint length, bytes
+// A keyframe is a VT stream that repaints the screen as it was once the output
+// up to its offset was parsed, so replay can start there on a reset terminal.
+
+// Appends records from any thread; a background thread writes them out, so a
+// slow disk never stalls the caller. If it falls kMaxPending behind, recording
+// stops and Ok() turns false.
+class SessionRecorder {
+public:
+    static constexpr size_t kMaxPending = 32u << 20;
+
+    SessionRecorder() = default;
+    ~SessionRecorder();
+    SessionRecorder(const SessionRecorder&) = delete;
+    SessionRecorder& operator=(const SessionRecorder&) = delete;
+
+    // Create (or truncate) the file. False if it cannot be opened.
+    bool Open(const std::string& path);
+    bool Ok() const;
+
+    void Data(const char* data, size_t len);
+    void Resize(uint64_t offset, int cols, int rows);
+    void Keyframe(uint64_t offset, int cols, int rows, const std::string& screen);
+
+private:
+    std::ofstream out;
+    std::thread writer;
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    std::string pending;                    // encoded records not yet written
+    bool stopping = false;
+    bool ok = false;
+    uint64_t last_us = 0;                   // time of the previous record
+
+    void begin_record(uint8_t type);
+    void write_loop();
+};
+
+// Replays a recording into a Terminal through Feed. The file is memory-mapped
+// and indexed once on Open; playback follows the recorded timing scaled by the
+// speed, or runs as fast as the terminal takes input. Seeking restarts from the
+// nearest earlier keyframe and fast-forwards from there.
+class SessionPlayer {
+public:
+    SessionPlayer() = default;
+    ~SessionPlayer();
+    SessionPlayer(const SessionPlayer&) = delete;
+    SessionPlayer& operator=(const SessionPlayer&) = delete;
+
+    // False if the file cannot be mapped or is not a recording.
+    bool Open(const std::string& path);
+    void Close();
+    bool IsOpen() const { return view != nullptr; }
+
+    double Duration() const;
+    double Position() const;
+    bool AtEnd() const { return chunk >= chunks.size(); }
+
+    // Multiple of recorded speed; 0 plays as fast as the terminal parses.
+    void SetSpeed(double s) { speed = s; }
+    double Speed() const { return speed; }
+    void SetPaused(bool p) { paused = p; }
+    bool Paused() const { return paused; }
+
+    // Reset `term` to the screen at `seconds` into the recording.
+    void Seek(Terminal& term, double seconds);
+    // Feed `term` what is due after `dt` more seconds of playback. Once per frame.
+    void Advance(Terminal& term, double dt);
+
+private:
+    struct Chunk {
+        uint64_t time_us;
+        uint64_t offset;        // in the output stream
+        const uint8_t* data;
+        size_t len;
+    };
+    struct Mark {
+        uint64_t offset;
+        int cols;
+        int rows;
+        const uint8_t* screen;  // keyframe bytes; null for a plain resize
+        size_t len;
+        uint64_t time_us;       // when it was recorded
+    };
+
+    const uint8_t* view = nullptr;
+    size_t view_size = 0;
+    std::vector<Chunk> chunks;
+    std::vector<Mark> marks;    // by offset
+
+    size_t chunk = 0;           // next chunk to feed
+    size_t chunk_pos = 0;       // bytes of it already fed
+    size_t mark = 0;            // next mark to apply
+    uint64_t clock_us = 0;      // playback position
+    const uint8_t* keyframe = nullptr;  // left to feed after a seek
+    size_t keyframe_left = 0;
+    double speed = 1.0;
+    bool paused = false;
+
+    bool index();
+};
@@ -3,6 +3,7 @@
 #include <atomic>
 #include <thread>
 #include <mutex>
+#include <functional>
 #include "SSHClient.h"
 
 struct ServerStats {
@@ -31,12 +32,16 @@ public:
     void Start(const std::string& host, int port, const std::string& user, const std::string& pass, const std::string& key);
     void Stop();
     void Render();
+    // Invoked from the poll thread after each new sample.
+    void SetNotifyCallback(std::function<void()> cb);
 
 private:
     SSHClient client; // Dedicated client for monitoring
     std::atomic<bool> running{false};
     std::thread monitor_thread;
     std::mutex data_mutex;
+    std::mutex notify_mutex;
+    std::function<void()> notify_callback;
     
     ServerStats stats;
     
@@ -1,21 +1,66 @@
 #pragma once
 #include "imgui.h"
+#include "ByteRing.h"
+#include "Scrollback.h"
+#include "CommandIndex.h"
+#include "GridRenderer.h"
+#include "HighlightRules.h"
+#include "LocalEcho.h"
+#include "SessionRecording.h"
+#include "TerminalSearch.h"
 #include <vterm.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 #include <optional>
 
 // Terminal wraps libvterm to emulate a modern VT with scrollback and ImGui rendering.
+// Each terminal parses on its own thread: Feed() queues output, the thread runs
+// libvterm and publishes an immutable snapshot of the screen after each batch,
+// and Render() draws the newest snapshot without waiting for the parser.
 class Terminal {
 public:
     Terminal(int cols = 100, int rows = 32);
     ~Terminal();
 
+    // Resize the emulator; Render also does this to fit the window.
     void Resize(int cols, int rows);
+    int Cols() const { return cols; }
+    int Rows() const { return rows; }
+    // The size to report to the remote PTY, once the window has settled on it.
+    // Dragging a splitter resizes locally every frame but yields one report.
+    bool TakePtyResize(int& out_cols, int& out_rows);
+    // Pin the screen to a size instead of fitting it to the window, e.g. to replay
+    // a recording at the size it was made. 0 unpins.
+    void SetFixedSize(int cols, int rows);
+    // The grid Render would fit into `size` pixels. False before the first Render
+    // has measured the font, or when there is no room.
+    bool FitSize(ImVec2 size, int& out_cols, int& out_rows) const;
 
-    // Feed remote output into the emulator.
-    void Feed(const std::string& data);
+    // Queue remote output for the parser thread. Returns the bytes taken, fewer
+    // than `len` once the input buffer is full; the caller keeps the rest.
+    size_t Feed(const std::string& data);
+    size_t Feed(const char* data, size_t len);
+    // Output was dropped between what was fed so far and what is fed next. Once
+    // the parser gets there it cancels (CAN) any escape sequence the gap cut short.
+    // Modes the dropped output set or ended stay as they were.
+    void DroppedOutput();
+    // Block until everything fed or queued so far is parsed and published.
+    // For tools and tests; must not be called from inside Render.
+    void Sync();
+    // The newest screen as text, a line per row. For tools and tests, after Sync.
+    std::string ScreenText();
+
+    // Invoked from the parser thread when a new snapshot or outgoing bytes are ready.
+    void SetNotifyCallback(std::function<void()> cb);
 
     // Render terminal contents inside current ImGui window.
     void Render();
@@ -25,41 +70,248 @@ public:
 
     void Reset();
     void ClearScrollback();
+    // Scrollback is sized by memory rather than line count. Clears history.
+    void SetScrollbackBudget(size_t bytes);
+    // Color output matching `rules` from now on, and the screen at once. Lines
+    // already in history keep the colors they were stored with.
+    void SetHighlightRules(const std::vector<HighlightRule>& rules);
+
+    // Record output fed from now on to `path`, starting with a keyframe of the
+    // current screen. Output dropped unparsed is left out. False if the file
+    // cannot be created.
+    bool StartRecording(const std::string& path);
+    void StopRecording();
+    bool Recording() const { return recorder != nullptr; }
+    // False once the recording could not keep up with output or failed to write.
+    bool RecordingOk() const { return !recorder || recorder->Ok(); }
+
+    // True while a newer snapshot is waiting, or background work such as a
+    // search scan needs more frames.
+    bool WantsFrame() const;
+
+    // True while output arrives faster than kFloodBytesPerSec. Parsing then skips
+    // per-cell screen updates and the grid is rebuilt once per snapshot, as it is
+    // during a synchronized update.
+    bool Flooding() const { return snapshots[front].flooding; }
 
 private:
-    struct Cell {
-        uint32_t codepoint = ' ';
-        VTermColor fg;
-        VTermColor bg;
-        bool bold = false;
-        bool underline = false;
-        bool reverse = false;
+    using Cell = TermCell;
+
+    // A screen row as the parser keeps it; `version` changes with its contents.
+    struct Row {
+        std::vector<Cell> cells;
+        uint64_t version = 0;
     };
 
     struct Line {
         std::vector<Cell> cells;
+        std::string text;        // plain UTF-8, rebuilt lazily when dirty
+        bool dirty = true;
+        uint64_t version = 0;    // of the Row it was copied from, or of the decode for scrollback
+    };
+
+    // What Render draws: the visible grid and cursor as of one parser batch.
+    // Scrollback.Size() matches it while sb_mutex is held.
+    struct Snapshot {
+        std::vector<Line> lines;
+        int cols = 0;
+        int rows = 0;
+        VTermPos cursor{0, 0};
+        bool cursor_visible = true;
+        bool altscreen = false;
+        Cell blank;
+        uint64_t grid_version = 0;
+        uint64_t sb_generation = 0;  // bumped when scrollback rows change in place
+        bool flooding = false;
+        double throughput = 0.0;
+        uint64_t flood_bytes = 0;
+    };
+
+    // Work for the parser thread. Keys go out as soon as the parser sees them;
+    // screen commands wait until the output fed before them has been parsed.
+    struct Command {
+        enum class Kind { Key, Char, Paste, Resize, Reset, ClearScrollback, SetBudget, Reflow, Record, Highlight, Cancel };
+        explicit Command(Kind k) : kind(k) {}
+        Kind kind;
+        VTermKey key = VTERM_KEY_NONE;
+        uint32_t ch = 0;
+        VTermModifier mods = VTERM_MOD_NONE;
+        int cols = 0;
+        int rows = 0;
+        uint64_t bytes = 0;      // scrollback budget
+        uint64_t mark = 0;       // input fed before the command was queued
+        std::string text;
+        std::shared_ptr<SessionRecorder> recorder;  // null stops recording
+        std::shared_ptr<HighlightRules> highlights;
     };
 
+    // --- Parser thread ---
     VTerm* vt = nullptr;
     VTermScreen* screen = nullptr;
     VTermState* state = nullptr;
-    int cols;
-    int rows;
+    int vt_cols;
+    int vt_rows;
     VTermPos cursor_pos{0,0};
+    uint32_t palette[256] = {}; // indexed colors resolved to packed RGBA
+    bool cursor_visible = true;
+    bool altscreen = false;
+
+    // Live screen, kept in sync from damage/moverect callbacks.
+    std::vector<Row> grid;
+    uint64_t grid_version = 0;  // bumped on every grid change
+    uint64_t row_clock = 0;     // source of Row versions
+    uint64_t sb_generation = 0;
+    bool changed = true;        // something to publish
+    bool published = false;     // a snapshot went out since the last notify
+    bool wrote = false;         // outgoing grew since the last notify
+    bool interrupted = false;   // a Ctrl+C went upstream
+
+    // Lines pushed since the last publish; moved into scrollback under sb_mutex.
+    struct StagedLine {
+        int cols;
+        bool continuation;
+    };
+    std::vector<StagedLine> staged;
+    std::vector<Cell> staged_cells;
+    std::vector<Cell> sb_cells; // conversion buffer for sb_popline
+
+    // OSC 133 marks seen since the last publish, applied to commands with the lines
+    struct StagedMark {
+        char kind;
+        uint64_t line;
+        int col;
+        int exit_code;
+    };
+    std::vector<StagedMark> staged_marks;
+    std::string osc_text;       // the OSC being received, across fragments
+
+    // Output-flood mode
+    bool flooding = false;
+    bool grid_stale = false;    // screen changed while updates were deferred
+    uint64_t rate_bytes = 0;    // parsed since rate_start
+    double rate_start = 0.0;
+    double throughput = 0.0;    // bytes/sec over the last window
+    uint64_t flood_bytes = 0;   // parsed since the flood began
+
+    // Synchronized output (DEC mode 2026): the application is mid-redraw, so
+    // snapshots are held until it ends the update or sync_deadline passes.
+    bool synchronized = false;
+    std::chrono::steady_clock::time_point sync_deadline;
 
-    std::deque<Line> scrollback;
-    size_t max_scrollback = 4000;
+    uint64_t parsed_bytes = 0;  // consumed from input, parsed or dropped
+    uint64_t done_commands = 0;
 
+    // Session recording: the bytes parsed, with keyframes and sizes at offsets into them
+    std::shared_ptr<SessionRecorder> recording;
+    uint64_t recorded_bytes = 0;
+    uint64_t keyframe_offset = 0;
+    std::chrono::steady_clock::time_point keyframe_time;
+
+    // Highlight rules, applied to rows entering history and to changed screen rows
+    std::shared_ptr<HighlightRules> highlights;
+
+    // --- Shared ---
+    std::thread parser;
+    ByteRing input;
+    uint64_t fed_bytes = 0;                 // producer side of input
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;        // parser waits for input or commands
+    std::condition_variable idle_cv;        // Sync waits for a publish
+    bool wake = false;
+    bool stopping = false;
+    uint64_t published_bytes = 0;           // under wake_mutex
+    uint64_t published_commands = 0;
+
+    std::mutex cmd_mutex;
+    std::vector<Command> commands;
+    std::vector<Command> taken_commands;    // parser's side, swapped with commands
+    std::deque<Command> pending;            // screen commands waiting for their mark
+    uint64_t queued_commands = 0;
+
+    std::mutex out_mutex;
     std::string outgoing;
+    std::mutex notify_mutex;
+    std::function<void()> notify_callback;
+
+    // Held by the parser only to publish or rewrite history, and by Render for
+    // the whole frame, so history never changes under a drawn or searched line.
+    std::mutex sb_mutex;
+    Scrollback scrollback;
+    CommandIndex command_index;  // shell-integration marks, in scrollback's line numbers
+
+    // Triple buffer: the parser fills snapshots[back] and swaps it into `ready`;
+    // Render swaps `front` with `ready` when kFreshSnapshot is set.
+    static constexpr int kFreshSnapshot = 4;
+    Snapshot snapshots[3];
+    int back = 0;
+    std::atomic<int> ready{1};
+    int front = 2;
+
+    // --- UI thread ---
+    int cols;                   // as requested by Resize
+    int rows;
+    bool fixed_size = false;
+    std::shared_ptr<SessionRecorder> recorder;  // the recording the parser writes to
+    uint64_t seen_generation = 0;
+
+    // Decoded scrollback rows by absolute line number, slot = line % size. Sized
+    // to the viewport, so frames decode only rows that newly scrolled into view.
+    struct CachedRow {
+        uint64_t line = ~0ull;
+        Line row;
+    };
+    std::vector<CachedRow> row_cache;
+    uint64_t decode_clock = 0;  // versions of decoded rows, kept apart from row_clock's
+
+    GridRenderer grid_renderer;
+
+    // Predictive local echo for keys typed ahead of the remote echo
+    LocalEcho echo;
+    std::vector<Cell> echo_cells;   // the cursor row with predictions applied
+
+    // Window fitting: the remote PTY and scrollback wrapping follow once the size settles
+    int pty_cols;
+    int pty_rows;
+    int sb_cols;                // width scrollback was last wrapped to
+    bool resize_settling = false;
+    double resize_time = 0.0;
+
+    // Find bar (Ctrl+Shift+F)
+    TerminalSearch search;
+    bool find_open = false;
+    bool find_focus = false;
+    bool find_regex = false;
+    bool find_error = false;
+    char find_buf[256] = "";
+    std::string find_query;
+    bool find_query_regex = false;
+    int scroll_to_line = -1;
+    bool scroll_line_top = false;   // put scroll_to_line at the top rather than the middle
+    std::vector<SearchMatch> visible_matches;
+    std::vector<std::string_view> screen_text;
 
-    // Selection
+    // Selection; col is a cell boundary (0..cols)
     struct SelPos { int line = 0; int col = 0; };
     bool selecting = false;
     std::optional<SelPos> sel_start;
     std::optional<SelPos> sel_end;
 
-    // State helpers
+    // Parser thread
     void init_vterm();
+    void parse_loop();
+    void take_commands();
+    void run_command(Command& cmd);
+    void run_due_commands();
+    void parse_input();
+    void drop_input(uint64_t n);
+    void record(const char* data, size_t len);
+    void publish(bool wait);
+    void fill_snapshot();
+    void flush_staged();
+    void flush_marks();
+    uint64_t screen_top() const;
+    void remap_marks(uint64_t old_top, uint64_t old_cursor);
+    void notify();
     static void write_callback(const char* s, size_t len, void* user);
     static int damage_callback(VTermRect rect, void* user);
     static int moverect_callback(VTermRect dest, VTermRect src, void* user);
@@ -67,20 +319,54 @@ private:
     static int settermprop_callback(VTermProp prop, VTermValue* val, void* user);
     static int bell_callback(void* user);
     static int resize_callback(int rows, int cols, void* user);
-    static int sb_pushline_callback(int cols, const VTermScreenCell* cells, void* user);
+    static int sb_pushline_callback(int cols, const VTermScreenCell* cells, bool continuation, void* user);
     static int sb_popline_callback(int cols, VTermScreenCell* cells, void* user);
+    static int osc_callback(int command, VTermStringFragment frag, void* user);
+
+    // Screen model helpers (parser thread)
+    void reset_grid();
+    void fetch_cells(const VTermRect& rect);
+    void move_cells(const VTermRect& dest, const VTermRect& src);
+    void refresh_palette();
+    uint32_t resolve_color(const VTermColor& c) const;
+    Cell make_cell(const VTermScreenCell& cell) const;
+    Cell blank_cell() const;
+    void update_throughput();
+    void record_keyframe(bool force);
+    std::string screen_keyframe() const;
+
+    // UI thread
+    void queue(Command cmd);
+    Snapshot& shown() { return snapshots[front]; }
+    void take_snapshot();
+    int total_lines() const;
+    const Line& line_at(int index);
+    void reserve_row_cache(int visible_rows);
+    void invalidate_row_cache();
+    std::string_view line_text(int index);
 
     // Rendering helpers
-    void rebuild_screen(std::vector<Line>& lines_out, std::vector<std::string>& plain_out);
-    ImVec4 color_to_vec(const VTermColor& c) const;
     std::string cell_text(const Cell& cell) const;
     bool has_selection() const;
     void clear_selection();
-    void copy_selection_to_clipboard(const ImVec2& origin, float line_height, const std::vector<std::string>& lines);
-    int point_to_col(const std::string& text, float x) const;
-    SelPos mouse_to_pos(const ImVec2& mouse, const ImVec2& origin, float line_height, const std::vector<std::string>& lines) const;
+    void copy_selection_to_clipboard();
+    SelPos mouse_to_pos(const ImVec2& mouse, const ImVec2& origin, float line_height);
     void paste_clipboard();
-    void send_control_char(char c);
 
     void handle_input();
+    LocalEcho::Screen echo_screen();
+    void fit_to_region(ImVec2 size);
+    void settle_resize();
+    void render_flood_indicator();
+
+    // Search helpers
+    void render_find_bar();
+    void update_search();
+    void jump_to_match(bool up);
+
+    // Command marks
+    void jump_to_command(bool up);
+    void copy_command_output(size_t index);
+    void draw_search_highlights(ImDrawList* dl, const ImVec2& origin, int first, int last);
+    static int byte_to_col(const Line& line, uint32_t byte);
 };
@@ -0,0 +1,97 @@
+#pragma once
+#include "TerminalStructs.h"
+#include "Scrollback.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// TerminalSearch finds a plain or regex pattern across scrollback and the live
+// screen. History is scanned newest-first in chunks split across a small worker
+// pool, and each Step() stops after a time budget so the frame never stalls;
+// lines pushed after the search started are picked up as they arrive. Matches
+// are kept sorted by absolute line so the renderer can look up visible ones.
+class TerminalSearch {
+public:
+    static constexpr size_t kMaxMatches = 1u << 20;
+
+    TerminalSearch();
+    ~TerminalSearch();
+
+    // Start a new search. An empty query clears. Returns false for a bad regex.
+    bool Begin(const std::string& query, bool regex);
+    void Clear();
+    // Forget all results but keep the query, e.g. after scrollback is cleared.
+    void Restart();
+
+    bool Active() const { return active; }
+    // The regex gave up on a line, as MSVC's does on patterns like (a*)*b; the
+    // search was cleared. Stays set until the next Begin.
+    bool Failed() const { return failed; }
+    bool Scanning() const { return active && !history_done; }
+    size_t Count() const { return matches.size() + screen_matches.size(); }
+
+    // Scan more lines. `screen` holds the live rows, which follow scrollback in
+    // absolute numbering; they are rescanned whenever `screen_version` changes.
+    void Step(const Scrollback& sb, const std::vector<std::string_view>& screen, uint64_t screen_version,
+              double budget_ms);
+
+    // Matches on absolute lines [first, last), in order.
+    void Visible(uint64_t first, uint64_t last, std::vector<SearchMatch>& out) const;
+
+    // Move the current match towards older (up) or newer lines, wrapping.
+    // Returns false when there is nothing to select.
+    bool Navigate(bool up);
+    bool HasCurrent() const { return has_current; }
+    const SearchMatch& Current() const { return current; }
+    // 1-based position of the current match, 0 if none.
+    size_t CurrentIndex() const;
+
+private:
+    using LineFn = std::function<std::string_view(uint64_t)>;
+
+    std::string pattern;
+    bool use_regex = false;
+    std::regex re;
+    bool active = false;
+    mutable std::atomic<bool> failed{false};    // set by whichever thread hit the error
+
+    std::deque<SearchMatch> matches;        // scrollback hits, ascending
+    std::vector<SearchMatch> screen_matches;
+    uint64_t screen_seen = ~0ull;
+    uint64_t screen_first = 0;              // absolute line of screen row 0 at last scan
+
+    uint64_t old_next = 0;                  // history below this is still to scan (going up)
+    uint64_t new_next = 0;                  // lines from here were pushed after Begin
+    bool history_done = true;
+    size_t chunk_lines = 0;
+
+    SearchMatch current{};
+    bool has_current = false;
+
+    // Worker pool: Run() splits [lo, hi) across workers and joins.
+    std::vector<std::thread> workers;
+    std::mutex pool_mutex;
+    std::condition_variable pool_cv;
+    std::condition_variable done_cv;
+    uint64_t job_id = 0;
+    int job_pending = 0;
+    bool stopping = false;
+    const LineFn* job_lines = nullptr;
+    uint64_t job_lo = 0, job_hi = 0;
+    std::vector<std::vector<SearchMatch>> job_out;
+
+    void worker_loop(int index);
+    void scan_slice(int index);
+    void run(const LineFn& lines, uint64_t lo, uint64_t hi, std::vector<SearchMatch>& out);
+    void find_in_line(uint64_t line, std::string_view text, std::vector<SearchMatch>& out) const;
+    const SearchMatch& at(size_t index) const;
+    size_t lower_bound_index(const SearchMatch& m) const;
+};
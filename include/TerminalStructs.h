@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+
+// One character cell of the terminal grid. Colors are resolved to packed RGBA
+// (IM_COL32 layout) when the cell enters the model, so drawing and run
+// splitting only compare integers.
+struct TermCell {
+    uint32_t codepoint = ' ';   // (uint32_t)-1 marks the right half of a wide glyph
+    uint32_t fg = 0;
+    uint32_t bg = 0;
+    bool bold = false;
+    bool underline = false;
+    bool reverse = false;
+    bool default_fg = true;     // color came from the terminal default, not SGR
+    bool default_bg = true;
+};
+
+// A search hit: absolute line number (scrollback eviction count included) and
+// byte range within that line's UTF-8 text.
+struct SearchMatch {
+    uint64_t line = 0;
+    uint32_t start = 0;
+    uint32_t end = 0;
+};
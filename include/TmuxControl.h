@@ -0,0 +1,95 @@
+#pragma once
+#include "Terminal.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// TmuxControl is a client for tmux control mode (`tmux -CC`). It sits between
+// the shell channel and the terminals: output goes to the main Terminal until
+// tmux announces control mode, and from then on it is read as notification
+// lines. `%output` is unescaped into a Terminal per pane, sized from
+// `%layout-change`, so each pane keeps native scrollback and only panes with new
+// output have anything to redraw. Keys typed into a pane go back as send-keys.
+// Panes that existed before attaching are filled from capture-pane.
+class TmuxControl {
+public:
+    struct Pane {
+        int id = -1;
+        int window = -1;
+        std::unique_ptr<Terminal> term;
+        bool syncing = false;       // waiting for its capture-pane; output before it is in the capture
+        int cursor_x = 0;
+        int cursor_y = 0;
+        std::string backlog;        // unescaped output the terminal had no room for
+    };
+    struct Window {
+        int id = -1;
+        std::string name;
+        std::vector<int> panes;     // in layout order
+    };
+
+    // Hand channel output to `main`, or to the panes while in control mode.
+    // Returns the bytes used; fewer than `len` when a terminal is full.
+    size_t Route(Terminal& main, const char* data, size_t len);
+    bool Active() const { return mode == Mode::Control; }
+    // Forget control mode and every pane, e.g. when the shell goes away.
+    void Reset();
+
+    // Forward keys typed into panes. Call once per frame while active.
+    void Pump();
+    // The client size tmux lays windows out for; sent when it changes.
+    void SetClientSize(int cols, int rows);
+    // Commands for tmux, to be written to the channel.
+    std::string TakeCommands();
+
+    const std::vector<Window>& Windows() const { return windows; }
+    Pane* FindPane(int id);
+    bool WantsFrame() const;
+    // Passed on to every pane terminal.
+    void SetNotifyCallback(std::function<void()> cb);
+    void SetHighlightRules(const std::vector<HighlightRule>& rules);
+
+private:
+    enum class Mode { Normal, Control, Exiting };
+    // A command sent to tmux, matched to its %begin/%end reply in order.
+    enum class Query { None, ListWindows, ListPanes, Capture };
+    struct Pending {
+        Query query;
+        int pane;
+    };
+
+    Mode mode = Mode::Normal;
+    size_t marker_match = 0;        // bytes of the control-mode marker, or of the closing ST, seen so far
+    size_t marker_fed = 0;          // of a held marker prefix that was not one, bytes passed on to main
+    std::string line;               // control line being assembled
+    std::string reply_guard;        // "%begin" arguments its %end or %error repeats
+    bool in_reply = false;
+    bool reply_ours = false;        // the reply answers one of our commands
+    Pending reply{Query::None, -1};
+    std::vector<std::string> reply_lines;
+    std::vector<Pending> sent;
+    std::string commands;
+
+    std::vector<Window> windows;
+    std::vector<Pane> panes;
+    int client_cols = 0;
+    int client_rows = 0;
+    std::function<void()> notify_callback;
+    std::vector<HighlightRule> highlight_rules;
+
+    size_t route_normal(Terminal& main, const char* data, size_t len);
+    size_t route_control(const char* data, size_t len);
+    void enter();
+    bool drain();
+    void feed(Pane& p);
+    void handle_line(const std::string& l);
+    void handle_reply(bool ok);
+    void resync();
+    void handle_output(int pane, const char* data, size_t len);
+    void apply_layout(int window, const std::string& layout, bool attaching);
+    void send(const std::string& command, Query query = Query::None, int pane = -1);
+    Window& window(int id);
+    Pane& add_pane(int id, int window, int cols, int rows);
+    void remove_pane(int id);
+};
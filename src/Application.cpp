@@ -13,6 +13,15 @@
 #include <algorithm>
 #include <filesystem>
 
+namespace {
+// ImGui needs a couple of frames after input for hover and popup state to settle.
+constexpr int kSettleFrames = 3;
+// Half of the terminal cursor blink period.
+constexpr Uint32 kBlinkIntervalMs = 500;
+// Backstop so a lost wake can never stall the UI for long.
+constexpr int kIdleTimeoutMs = 1000;
+} // namespace
+
 Application::Application() {
     std::string home = Platform::GetHomeDir();
     if (!home.empty()) {
@@ -31,6 +40,14 @@ Application::Application() {
     }
 
     history_hosts = SSHConfigParser::load_history(history_path);
+
+    highlights_path = (config_dir / "highlights.conf").string();
+    std::ifstream rules_in(highlights_path, std::ios::binary);
+    if (rules_in) {
+        rules_in.read(highlights_text, sizeof(highlights_text) - 1);
+        highlights_text[rules_in.gcount()] = '\0';
+        ApplyHighlightRules(false);
+    }
 }
 
 Application::~Application() {
@@ -70,9 +87,52 @@ bool Application::Init() {
     ImGui_ImplSDL2_InitForSDLRenderer(window, renderer);
     ImGui_ImplSDLRenderer2_Init(renderer);
 
+    wake_event = SDL_RegisterEvents(1);
+    sshClient.set_notify_callback([this]() { PostWake(); });
+    monitor.SetNotifyCallback([this]() { PostWake(); });
+    terminal.SetNotifyCallback([this]() { PostWake(); });
+    tmux.SetNotifyCallback([this]() { PostWake(); });
+
     return true;
 }
 
+// Safe from any thread. Coalesces so a busy channel posts one event per frame.
+void Application::PostWake() {
+    if (wake_event == (Uint32)-1 || wake_pending.exchange(true)) return;
+    SDL_Event event{};
+    event.type = wake_event;
+    SDL_PushEvent(&event);
+}
+
+Uint32 Application::BlinkTimerCallback(Uint32 interval, void* param) {
+    static_cast<Application*>(param)->PostWake();
+    return interval;
+}
+
+// Cursors only blink while the window has keyboard focus; no timer otherwise.
+void Application::UpdateBlinkTimer() {
+    bool focused = (SDL_GetWindowFlags(window) & SDL_WINDOW_INPUT_FOCUS) != 0;
+    if (focused && !blink_timer) {
+        blink_timer = SDL_AddTimer(kBlinkIntervalMs, &Application::BlinkTimerCallback, this);
+    } else if (!focused && blink_timer) {
+        SDL_RemoveTimer(blink_timer);
+        blink_timer = 0;
+    }
+}
+
+void Application::HandleEvent(const SDL_Event& event) {
+    if (event.type == wake_event) {
+        wake_pending = false;
+        frames_to_render = std::max(frames_to_render, 1);
+        return;
+    }
+    ImGui_ImplSDL2_ProcessEvent(&event);
+    frames_to_render = kSettleFrames;
+    if (event.type == SDL_QUIT) running = false;
+    if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE && event.window.windowID == SDL_GetWindowID(window))
+        running = false;
+}
+
 void Application::ApplyDarkTheme() {
     ImGuiStyle& style = ImGui::GetStyle();
     style.Colors[ImGuiCol_Text]                   = ImVec4(0.90f, 0.90f, 0.90f, 1.00f);
@@ -108,6 +168,18 @@ void Application::ApplyDarkTheme() {
 }
 
 void Application::Cleanup() {
+    if (blink_timer) {
+        SDL_RemoveTimer(blink_timer);
+        blink_timer = 0;
+    }
+    // Join the reader and poll threads first, so none of them wakes SDL once it is gone.
+    sshClient.disconnect();
+    monitor.Stop();
+    sshClient.set_notify_callback(nullptr);
+    monitor.SetNotifyCallback(nullptr);
+    terminal.SetNotifyCallback(nullptr);
+    tmux.Reset();
+    replay_terminal.reset();
     ImGui_ImplSDLRenderer2_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
@@ -119,14 +191,21 @@ void Application::Cleanup() {
 void Application::Run() {
     ImVec4 clear_color = ImVec4(0.05f, 0.05f, 0.05f, 1.00f);
 
+    frames_to_render = kSettleFrames;
     while (running) {
+        UpdateBlinkTimer();
+
+        // Sleep until something happens, unless frames are still settling or
+        // the shell reader or terminal still has work queued.
+        bool busy = frames_to_render > 0 || !sshClient.get_shell_output().Empty() || terminal.WantsFrame() || tmux.WantsFrame() ||
+                    (replay_terminal && (replay_terminal->WantsFrame() || (!player.Paused() && !player.AtEnd())));
         SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            ImGui_ImplSDL2_ProcessEvent(&event);
-            if (event.type == SDL_QUIT) running = false;
-             if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE && event.window.windowID == SDL_GetWindowID(window))
-                running = false;
+        if (SDL_WaitEventTimeout(&event, busy ? 0 : kIdleTimeoutMs)) {
+            HandleEvent(event);
+            while (SDL_PollEvent(&event)) HandleEvent(event);
         }
+        if (!running) break;
+        if (frames_to_render > 0) frames_to_render--;
 
         ImGui_ImplSDLRenderer2_NewFrame();
         ImGui_ImplSDL2_NewFrame();
@@ -147,9 +226,18 @@ void Application::Run() {
                 }
                 if (ImGui::MenuItem("Reset In-App Terminal")) {
                     terminal.Reset();
+                    tmux.Reset();
                     shell_ready = false;
                 }
                 ImGui::Separator();
+                if (!terminal.Recording()) {
+                    if (ImGui::MenuItem("Start Recording...")) StartRecording();
+                } else if (ImGui::MenuItem("Stop Recording")) {
+                    terminal.StopRecording();
+                }
+                if (ImGui::MenuItem("Replay Recording...")) OpenReplay();
+                if (ImGui::MenuItem("Highlight Rules...")) highlights_open = true;
+                ImGui::Separator();
                 if (ImGui::MenuItem("Send Ctrl+C")) sshClient.send_shell_command("\x03");
                 if (ImGui::MenuItem("Send Ctrl+Z")) sshClient.send_shell_command("\x1A");
                 if (ImGui::MenuItem("Send Ctrl+D")) sshClient.send_shell_command("\x04");
@@ -188,6 +276,8 @@ void Application::Run() {
         } else {
             RenderWorkspace();
         }
+        RenderReplay();
+        RenderHighlightRules();
 
         ImGui::Render();
         SDL_RenderSetScale(renderer, ImGui::GetIO().DisplayFramebufferScale.x, ImGui::GetIO().DisplayFramebufferScale.y);
@@ -304,6 +394,7 @@ void Application::RenderLogin() {
     
     if (sshClient.is_authenticated()) {
         state = AppState::CONNECTED;
+        frames_to_render = kSettleFrames; // lay out the workspace and open the shell
         files_need_refresh = true;
         sftpClient.init(sshClient.get_session(), &sshClient.get_mutex());
         monitor.Start(host_input, atoi(port_input), user_input, pass_input, key_path_input);
@@ -313,6 +404,7 @@ void Application::RenderLogin() {
         history_index = 0;
         shell_ready = false;
         terminal.Reset();
+        tmux.Reset();
         
         // Save to history
         SSHHost h;
@@ -521,36 +613,180 @@ void Application::RenderTerminal() {
     }
 
     if (!shell_ready) {
-        if (sshClient.init_shell()) {
+        if (sshClient.init_shell(terminal.Cols(), terminal.Rows())) {
             shell_ready = true;
         } else {
             ImGui::TextColored(ImVec4(1,0.5f,0.5f,1), "Shell not ready. Check authentication.");
             if (ImGui::Button("Retry Shell Init")) {
-                shell_ready = sshClient.init_shell();
+                shell_ready = sshClient.init_shell(terminal.Cols(), terminal.Rows());
             }
             ImGui::End();
             return;
         }
     }
 
-    // Pull remote output
-    std::string chunk = sshClient.read_shell_output();
-    while (!chunk.empty()) {
-        terminal.Feed(chunk);
-        chunk = sshClient.read_shell_output();
+    // Hand what the reader thread has buffered to the terminal's parser thread.
+    // What does not fit waits in the ring (and backs up into the socket); parsing
+    // never runs here, so input and drawing keep their pace while output floods in.
+    ByteRing& output = sshClient.get_shell_output();
+    const char* data;
+    while (size_t len = output.ReadSpan(&data)) {
+        size_t fed = tmux.Route(terminal, data, len);
+        output.Consume(fed);
+        if (fed < len) break;
+    }
+
+    if (tmux.Active()) {
+        RenderTmuxPanes();
+        ImGui::End();
+        return;
     }
 
+    if (terminal.Recording()) {
+        if (terminal.RecordingOk()) ImGui::TextColored(ImVec4(1, 0.3f, 0.3f, 1), "Recording");
+        else ImGui::TextColored(ImVec4(1, 0.5f, 0.5f, 1), "Recording stopped: could not write fast enough");
+    }
     terminal.Render();
 
+    // The panel size drives the remote PTY, debounced by the terminal
+    int pty_cols, pty_rows;
+    if (terminal.TakePtyResize(pty_cols, pty_rows)) {
+        sshClient.resize_shell(pty_cols, pty_rows);
+    }
+
     // Send user input
     std::string outgoing = terminal.ConsumeOutgoing();
     if (!outgoing.empty()) {
         sshClient.send_shell_command(outgoing);
+        // Ctrl+C during a flood: drop the backlog too, so the interrupt shows up
+        // now instead of after megabytes of output that were already in flight.
+        // The cut lands anywhere, so the terminal cancels whatever sequence it split.
+        if (terminal.Flooding() && outgoing.find('\x03') != std::string::npos) {
+            output.Consume(output.Size());
+            terminal.DroppedOutput();
+        }
     }
 
     ImGui::End();
 }
 
+void Application::StartRecording() {
+    std::string path = Platform::SaveFileDialog("session.shrec", Platform::GetHomeDir());
+    if (path.empty()) return;
+    if (!terminal.StartRecording(path)) {
+        snprintf(status_msg, sizeof(status_msg), "Could not create %s", path.c_str());
+    }
+}
+
+void Application::ApplyHighlightRules(bool save) {
+    highlights_errors.clear();
+    std::vector<HighlightRule> rules = HighlightRules::Parse(highlights_text, &highlights_errors);
+    terminal.SetHighlightRules(rules);
+    tmux.SetHighlightRules(rules);
+    if (!save) return;
+    std::ofstream out(highlights_path, std::ios::binary | std::ios::trunc);
+    out << highlights_text;
+    if (!out) highlights_errors += "could not save " + highlights_path + "\n";
+}
+
+void Application::RenderHighlightRules() {
+    if (!highlights_open) return;
+    ImGui::SetNextWindowSize(ImVec2(520, 360), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Highlight Rules", &highlights_open)) {
+        ImGui::TextDisabled("One rule per line: RRGGBB pattern, or RRGGBB /regex/. # starts a comment.");
+        ImGui::TextDisabled("Output is colored as it arrives; earlier history keeps its colors.");
+        float footer = ImGui::GetFrameHeightWithSpacing() + (highlights_errors.empty() ? 0.0f : ImGui::GetTextLineHeightWithSpacing() * 3);
+        ImGui::InputTextMultiline("##rules", highlights_text, sizeof(highlights_text),
+                                  ImVec2(-1, -footer), ImGuiInputTextFlags_AllowTabInput);
+        if (ImGui::Button("Apply and Save")) ApplyHighlightRules(true);
+        if (!highlights_errors.empty()) ImGui::TextColored(ImVec4(1, 0.5f, 0.5f, 1), "%s", highlights_errors.c_str());
+    }
+    ImGui::End();
+}
+
+// One tab per tmux pane, each its own Terminal at the size tmux gave it. The
+// panel size goes to tmux as the client size, which it lays windows out in.
+void Application::RenderTmuxPanes() {
+    if (ImGui::BeginTabBar("tmux_panes")) {
+        for (const TmuxControl::Window& w : tmux.Windows()) {
+            for (int id : w.panes) {
+                TmuxControl::Pane* pane = tmux.FindPane(id);
+                if (!pane) continue;
+                std::string label = w.name.empty() ? "@" + std::to_string(w.id) : w.name;
+                if (w.panes.size() > 1) label += " %" + std::to_string(id);
+                label += "###pane" + std::to_string(id);
+                if (ImGui::BeginTabItem(label.c_str())) {
+                    int cols, rows;
+                    if (pane->term->FitSize(ImGui::GetContentRegionAvail(), cols, rows)) tmux.SetClientSize(cols, rows);
+                    pane->term->Render();
+                    ImGui::EndTabItem();
+                }
+            }
+        }
+        ImGui::EndTabBar();
+    }
+    tmux.Pump();
+    std::string commands = tmux.TakeCommands();
+    if (!commands.empty()) sshClient.send_shell_command(commands);
+}
+
+void Application::OpenReplay() {
+    std::string path = PickLocalFile();
+    if (path.empty()) return;
+    if (!player.Open(path)) {
+        snprintf(status_msg, sizeof(status_msg), "Not a readable recording: %s", path.c_str());
+        return;
+    }
+    replay_terminal = std::make_unique<Terminal>();
+    replay_terminal->SetNotifyCallback([this]() { PostWake(); });
+    player.SetPaused(false);
+    player.Seek(*replay_terminal, 0.0);
+}
+
+// Plays the open recording into its own terminal, at the size it was recorded.
+void Application::RenderReplay() {
+    if (!replay_terminal) return;
+    bool open = true;
+    ImGui::Begin("Replay", &open);
+
+    if (ImGui::Button(player.Paused() ? "Play" : "Pause")) {
+        if (player.Paused() && player.AtEnd()) player.Seek(*replay_terminal, 0.0);
+        player.SetPaused(!player.Paused());
+    }
+    ImGui::SameLine();
+    static const char* speed_labels[] = {"1x", "2x", "4x", "16x", "Max"};
+    static const double speeds[] = {1.0, 2.0, 4.0, 16.0, 0.0};
+    int speed_index = 0;
+    for (int i = 0; i < IM_ARRAYSIZE(speeds); ++i) {
+        if (player.Speed() == speeds[i]) speed_index = i;
+    }
+    ImGui::SetNextItemWidth(80);
+    if (ImGui::Combo("##speed", &speed_index, speed_labels, IM_ARRAYSIZE(speed_labels))) {
+        player.SetSpeed(speeds[speed_index]);
+    }
+    ImGui::SameLine();
+    // Seek once the slider is let go; each seek resets and replays from a keyframe.
+    float duration = (float)player.Duration();
+    float pos = replay_scrub >= 0.0f ? replay_scrub : (float)player.Position();
+    ImGui::SetNextItemWidth(-1);
+    if (ImGui::SliderFloat("##position", &pos, 0.0f, duration, "%.1f s")) replay_scrub = pos;
+    if (ImGui::IsItemDeactivated() && replay_scrub >= 0.0f) {
+        player.Seek(*replay_terminal, replay_scrub);
+        replay_scrub = -1.0f;
+    }
+
+    player.Advance(*replay_terminal, ImGui::GetIO().DeltaTime);
+    replay_terminal->Render();
+    replay_terminal->ConsumeOutgoing(); // keys typed into a replay go nowhere
+    ImGui::End();
+
+    if (!open) {
+        player.Close();
+        replay_terminal.reset();
+        replay_scrub = -1.0f;
+    }
+}
+
 void Application::RefreshFileList() {
     current_files = sftpClient.list_directory(current_path);
 }
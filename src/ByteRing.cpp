@@ -0,0 +1,43 @@
+#include "ByteRing.h"
+#include <algorithm>
+
+ByteRing::ByteRing(size_t capacity) {
+    size_t cap = 1;
+    while (cap < capacity) cap <<= 1;
+    buf.reset(new char[cap]);
+    mask = cap - 1;
+}
+
+size_t ByteRing::WriteSpan(char** out) {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_acquire);
+    size_t free_bytes = Capacity() - (h - t);
+    size_t off = h & mask;
+    *out = buf.get() + off;
+    return std::min(free_bytes, Capacity() - off);
+}
+
+void ByteRing::Commit(size_t n) {
+    head.store(head.load(std::memory_order_relaxed) + n, std::memory_order_release);
+}
+
+size_t ByteRing::ReadSpan(const char** out) const {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    size_t off = t & mask;
+    *out = buf.get() + off;
+    return std::min(h - t, Capacity() - off);
+}
+
+void ByteRing::Consume(size_t n) {
+    tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+}
+
+size_t ByteRing::Size() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
+
+void ByteRing::Reset() {
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+}
@@ -3,6 +3,7 @@
 #include <filesystem>
 #include <iostream>
 #include <cstdlib>
+#include <chrono>
 
 SSHClient::SSHClient() {
     my_session = ssh_new();
@@ -19,6 +20,7 @@ SSHClient::~SSHClient() {
 }
 
 void SSHClient::disconnect() {
+    stop_shell_reader();
     join_worker();
     std::lock_guard<std::recursive_mutex> lock(session_mutex);
     close_shell_channel();
@@ -29,6 +31,16 @@ void SSHClient::disconnect() {
     authenticated_flag = false;
 }
 
+void SSHClient::set_notify_callback(std::function<void()> cb) {
+    std::lock_guard<std::mutex> lock(notify_mutex);
+    notify_callback = std::move(cb);
+}
+
+void SSHClient::notify() {
+    std::lock_guard<std::mutex> lock(notify_mutex);
+    if (notify_callback) notify_callback();
+}
+
 void SSHClient::set_error(const std::string& err) {
     std::lock_guard<std::mutex> lock(error_mutex);
     last_error = err;
@@ -55,9 +67,10 @@ void SSHClient::connect(const std::string& hostname, int port) {
     bool expected = false;
     if (!busy_flag.compare_exchange_strong(expected, true)) return;
     
+    stop_shell_reader();
     join_worker();
     worker_thread = std::thread([this, hostname, port]() {
-        struct BusyReset { std::atomic<bool>& flag; ~BusyReset(){ flag = false; } } reset{busy_flag};
+        struct BusyReset { SSHClient* self; ~BusyReset(){ self->busy_flag = false; self->notify(); } } reset{this};
         std::lock_guard<std::recursive_mutex> lock(session_mutex);
         close_shell_channel();
         authenticated_flag = false;
@@ -104,7 +117,7 @@ void SSHClient::authenticate(const std::string& user, const std::string& passwor
      
     join_worker();
     worker_thread = std::thread([this, user, password, key_path]() {
-        struct BusyReset { std::atomic<bool>& flag; ~BusyReset(){ flag = false; } } reset{busy_flag};
+        struct BusyReset { SSHClient* self; ~BusyReset(){ self->busy_flag = false; self->notify(); } } reset{this};
         std::lock_guard<std::recursive_mutex> lock(session_mutex);
         int rc;
 
@@ -157,8 +170,9 @@ void SSHClient::authenticate(const std::string& user, const std::string& passwor
     });
 }
 
-bool SSHClient::init_shell() {
+bool SSHClient::init_shell(int cols, int rows) {
     if (!connected_flag || !authenticated_flag) return false;
+    stop_shell_reader();
     std::lock_guard<std::recursive_mutex> lock(session_mutex);
     
     close_shell_channel();
@@ -175,13 +189,14 @@ bool SSHClient::init_shell() {
         return false;
     }
 
-    ssh_channel_change_pty_size(shell_channel, 80, 24);
+    ssh_channel_change_pty_size(shell_channel, cols, rows);
 
     if (ssh_channel_request_shell(shell_channel) != SSH_OK) {
         close_shell_channel();
         return false;
     }
 
+    start_shell_reader();
     return true;
 }
 
@@ -193,17 +208,60 @@ void SSHClient::send_shell_command(const std::string& cmd) {
     }
 }
 
-std::string SSHClient::read_shell_output() {
+void SSHClient::resize_shell(int cols, int rows) {
     std::lock_guard<std::recursive_mutex> lock(session_mutex);
-    if (!shell_channel || !ssh_channel_is_open(shell_channel)) return "";
+    if (shell_channel && ssh_channel_is_open(shell_channel)) {
+        ssh_channel_change_pty_size(shell_channel, cols, rows);
+    }
+}
 
-    char buffer[4096];
-    int nbytes = ssh_channel_read_nonblocking(shell_channel, buffer, sizeof(buffer), 0);
-    
-    if (nbytes > 0) {
-        return std::string(buffer, nbytes);
+void SSHClient::start_shell_reader() {
+    shell_output.Reset();
+    shell_reader_running = true;
+    shell_reader = std::thread(&SSHClient::shell_reader_loop, this);
+}
+
+// Must be called without session_mutex held: the reader takes it to drain.
+void SSHClient::stop_shell_reader() {
+    shell_reader_running = false;
+    if (shell_reader.joinable()) {
+        shell_reader.join();
+    }
+}
+
+void SSHClient::shell_reader_loop() {
+    while (shell_reader_running) {
+        char* dst;
+        if (shell_output.WriteSpan(&dst) == 0) {
+            // Consumer is behind; leaving data in the channel lets the SSH window push back.
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        // Other users of the session (SFTP, exec) may buffer our channel data while
+        // they hold the lock, so poll with a timeout rather than trusting the socket.
+        Platform::WaitSocketReadable((intptr_t)ssh_get_fd(my_session), 50);
+
+        std::lock_guard<std::recursive_mutex> lock(session_mutex);
+        if (!shell_channel || !ssh_channel_is_open(shell_channel) || ssh_channel_is_eof(shell_channel)) {
+            break;
+        }
+        bool got_data = false;
+        for (;;) {
+            size_t space = shell_output.WriteSpan(&dst);
+            if (space == 0) break;
+            int nbytes = ssh_channel_read_nonblocking(shell_channel, dst, (uint32_t)space, 0);
+            if (nbytes < 0) {
+                shell_reader_running = false;
+                break;
+            }
+            if (nbytes == 0) break;
+            shell_output.Commit((size_t)nbytes);
+            got_data = true;
+        }
+        if (got_data) notify();
     }
-    return "";
+    notify();
 }
 
 std::string SSHClient::exec_command_sync(const std::string& cmd) {
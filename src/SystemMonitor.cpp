@@ -37,6 +37,11 @@ void SystemMonitor::Stop() {
     }
 }
 
+void SystemMonitor::SetNotifyCallback(std::function<void()> cb) {
+    std::lock_guard<std::mutex> lock(notify_mutex);
+    notify_callback = std::move(cb);
+}
+
 void SystemMonitor::PollLoop() {
     // 1. Connect
     client.connect(m_host, m_port);
@@ -83,6 +88,10 @@ void SystemMonitor::PollLoop() {
             std::lock_guard<std::mutex> lock(data_mutex);
             ParseData(output);
         }
+        {
+            std::lock_guard<std::mutex> lock(notify_mutex);
+            if (notify_callback) notify_callback();
+        }
 
         std::this_thread::sleep_for(std::chrono::seconds(1));
     }
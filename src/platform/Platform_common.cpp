@@ -1,15 +1,21 @@
 #include "Platform.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <filesystem>
 #include <system_error>
 
 #if defined(_WIN32)
+#  include <winsock2.h>
 #  include <windows.h>
 #  include <shlobj.h>
 #else
+#  include <fcntl.h>
 #  include <pwd.h>
+#  include <poll.h>
 #  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
 #  include <sys/types.h>
 #endif
 
@@ -68,6 +74,125 @@ std::string GetTempDir() {
     return p.string();
 }
 
+intptr_t OpenScratchFile(const std::string& prefix) {
+#if defined(_WIN32)
+    wchar_t dir[MAX_PATH + 1];
+    wchar_t path[MAX_PATH + 1];
+    std::wstring wprefix(prefix.begin(), prefix.end());
+    if (!::GetTempPathW(MAX_PATH + 1, dir) || !::GetTempFileNameW(dir, wprefix.c_str(), 0, path)) return -1;
+    HANDLE h = ::CreateFileW(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                             CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+    return h == INVALID_HANDLE_VALUE ? -1 : (intptr_t)h;
+#else
+    std::string path = (std::filesystem::path(GetTempDir()) / (prefix + "-XXXXXX")).string();
+    int fd = ::mkstemp(path.data());
+    if (fd < 0) return -1;
+    ::unlink(path.c_str()); // storage is released once the descriptor closes
+    return fd;
+#endif
+}
+
+bool AppendScratchFile(intptr_t file, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+#if defined(_WIN32)
+    LARGE_INTEGER zero{};
+    if (!::SetFilePointerEx((HANDLE)file, zero, nullptr, FILE_END)) return false;
+    while (size > 0) {
+        DWORD written = 0;
+        DWORD chunk = (DWORD)std::min<size_t>(size, 1u << 30);
+        if (!::WriteFile((HANDLE)file, p, chunk, &written, nullptr) || written == 0) return false;
+        p += written;
+        size -= written;
+    }
+#else
+    while (size > 0) {
+        ssize_t n = ::write((int)file, p, size);
+        if (n <= 0) return false;
+        p += n;
+        size -= (size_t)n;
+    }
+#endif
+    return true;
+}
+
+const void* MapScratchFile(intptr_t file, size_t size) {
+    if (size == 0) return nullptr;
+#if defined(_WIN32)
+    HANDLE mapping = ::CreateFileMappingW((HANDLE)file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) return nullptr;
+    // The view keeps the mapping object alive after its handle is closed.
+    void* view = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+    ::CloseHandle(mapping);
+    return view;
+#else
+    void* view = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, (int)file, 0);
+    return view == MAP_FAILED ? nullptr : view;
+#endif
+}
+
+void UnmapScratchFile(const void* view, size_t size) {
+    if (!view) return;
+#if defined(_WIN32)
+    (void)size;
+    ::UnmapViewOfFile(view);
+#else
+    ::munmap(const_cast<void*>(view), size);
+#endif
+}
+
+void CloseScratchFile(intptr_t file) {
+    if (file < 0) return;
+#if defined(_WIN32)
+    ::CloseHandle((HANDLE)file);
+#else
+    ::close((int)file);
+#endif
+}
+
+const void* MapFile(const std::string& path, size_t& size) {
+    size = 0;
+    const void* view = nullptr;
+#if defined(_WIN32)
+    HANDLE h = ::CreateFileW(std::filesystem::path(path).wstring().c_str(), GENERIC_READ,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) return nullptr;
+    LARGE_INTEGER len;
+    if (::GetFileSizeEx(h, &len) && len.QuadPart > 0) {
+        view = MapScratchFile((intptr_t)h, (size_t)len.QuadPart);
+        if (view) size = (size_t)len.QuadPart;
+    }
+    ::CloseHandle(h);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        view = MapScratchFile(fd, (size_t)st.st_size);
+        if (view) size = (size_t)st.st_size;
+    }
+    ::close(fd); // the mapping outlives the descriptor
+#endif
+    return view;
+}
+
+void UnmapFile(const void* view, size_t size) {
+    UnmapScratchFile(view, size);
+}
+
+bool WaitSocketReadable(intptr_t socket, int timeout_ms) {
+#if defined(_WIN32)
+    WSAPOLLFD pfd{};
+    pfd.fd = (SOCKET)socket;
+    pfd.events = POLLRDNORM;
+    return ::WSAPoll(&pfd, 1, timeout_ms) != 0;
+#else
+    struct pollfd pfd{};
+    pfd.fd = (int)socket;
+    pfd.events = POLLIN;
+    return ::poll(&pfd, 1, timeout_ms) != 0;
+#endif
+}
+
 void OpenInFileManager(const std::string& /*path*/) {
     // Optional convenience; not wired into the UI today.
 }
@@ -0,0 +1,224 @@
+#include "ColdStore.h"
+#include "Platform.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace {
+
+// Raw block layout: u32 line count, u32 record offsets, then the records. Records
+// keep their 4-byte alignment so they can be read in place once decompressed.
+constexpr int kHashBits = 14;
+constexpr size_t kMinMatch = 4;
+
+std::atomic<uint64_t> next_store_id{1};
+
+uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+void put_varint(std::vector<uint8_t>& out, size_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+bool get_varint(const uint8_t*& p, const uint8_t* end, size_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= (size_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// Greedy LZ77 with a single-probe hash table, in the spirit of LZ4: scrollback is
+// mostly repeated prompts, paths and attribute runs, which this catches cheaply.
+// Sequences are (literal length, literals, match offset, match length - 4); the
+// stream ends with a literal run that reaches the end of the input.
+void compress(const uint8_t* src, size_t n, std::vector<uint8_t>& out) {
+    out.clear();
+    std::vector<uint32_t> table(1u << kHashBits, 0);
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + kMinMatch <= n) {
+        uint32_t word = read32(src + i);
+        uint32_t h = (word * 2654435761u) >> (32 - kHashBits);
+        size_t cand = table[h];
+        table[h] = (uint32_t)(i + 1);
+        if (cand == 0 || read32(src + cand - 1) != word) {
+            i++;
+            continue;
+        }
+        cand--;
+        size_t len = kMinMatch;
+        while (i + len < n && src[cand + len] == src[i + len]) len++;
+        put_varint(out, i - anchor);
+        out.insert(out.end(), src + anchor, src + i);
+        put_varint(out, i - cand);
+        put_varint(out, len - kMinMatch);
+        i += len;
+        anchor = i;
+    }
+    put_varint(out, n - anchor);
+    out.insert(out.end(), src + anchor, src + n);
+}
+
+bool decompress(const uint8_t* src, size_t packed, uint8_t* dst, size_t raw) {
+    const uint8_t* p = src;
+    const uint8_t* end = src + packed;
+    size_t o = 0;
+    for (;;) {
+        size_t lit;
+        if (!get_varint(p, end, lit) || lit > (size_t)(end - p) || lit > raw - o) return false;
+        memcpy(dst + o, p, lit);
+        p += lit;
+        o += lit;
+        if (p == end) return o == raw;
+        size_t off, len;
+        if (!get_varint(p, end, off) || !get_varint(p, end, len)) return false;
+        len += kMinMatch;
+        if (off == 0 || off > o || len > raw - o) return false;
+        // Byte copy: matches may overlap their own output.
+        const uint8_t* from = dst + o - off;
+        for (size_t k = 0; k < len; ++k) dst[o + k] = from[k];
+        o += len;
+    }
+}
+
+// Decompressed blocks, per thread so search workers can page in concurrently.
+struct CachedBlock {
+    uint64_t store = 0;
+    uint64_t generation = 0;
+    size_t block = ~(size_t)0;
+    std::vector<uint8_t> data;
+};
+
+thread_local CachedBlock block_cache[2];
+
+} // namespace
+
+ColdStore::ColdStore() : id(next_store_id++) {
+    open_block.reserve(kBlockBytes);
+    Clear();
+}
+
+ColdStore::~ColdStore() {
+    release();
+}
+
+void ColdStore::release() {
+    if (view) Platform::UnmapScratchFile(view, (size_t)file_size);
+    if (file != -1) Platform::CloseScratchFile(file);
+    view = nullptr;
+    file = -1;
+    file_size = 0;
+}
+
+void ColdStore::Clear() {
+    release();
+    blocks.clear();
+    lines = 0;
+    open_block.clear();
+    open_offsets.clear();
+    open_first = 0;
+    generation++;
+    ok = true;
+}
+
+void ColdStore::Append(const uint8_t* record, size_t bytes) {
+    if (!ok) return;
+    if (!open_offsets.empty() && open_block.size() + bytes > kBlockBytes && !flush()) return;
+    open_offsets.push_back((uint32_t)open_block.size());
+    open_block.insert(open_block.end(), record, record + bytes);
+    lines++;
+}
+
+bool ColdStore::flush() {
+    if (file == -1) {
+        file = Platform::OpenScratchFile("shadowssh-sb");
+        if (file == -1) {
+            ok = false;
+            return false;
+        }
+    }
+
+    uint32_t count = (uint32_t)open_offsets.size();
+    uint32_t header = (uint32_t)((1 + count) * sizeof(uint32_t));
+    std::vector<uint8_t> raw(header + open_block.size());
+    memcpy(raw.data(), &count, sizeof(count));
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t off = header + open_offsets[i];
+        memcpy(raw.data() + (1 + i) * sizeof(uint32_t), &off, sizeof(off));
+    }
+    memcpy(raw.data() + header, open_block.data(), open_block.size());
+
+    std::vector<uint8_t> packed;
+    compress(raw.data(), raw.size(), packed);
+    // Incompressible blocks are stored as is; equal sizes mark them.
+    const std::vector<uint8_t>& out = packed.size() < raw.size() ? packed : raw;
+
+    if (!Platform::AppendScratchFile(file, out.data(), out.size())) {
+        ok = false;
+        return false;
+    }
+    Block b;
+    b.offset = file_size;
+    b.packed_bytes = (uint32_t)out.size();
+    b.raw_bytes = (uint32_t)raw.size();
+    b.first_line = open_first;
+    b.lines = count;
+
+    // Map the grown file before dropping the old view, so a failure keeps what was readable.
+    const uint8_t* grown = static_cast<const uint8_t*>(Platform::MapScratchFile(file, (size_t)(file_size + out.size())));
+    if (!grown) {
+        ok = false;
+        return false;
+    }
+    if (view) Platform::UnmapScratchFile(view, (size_t)file_size);
+    view = grown;
+    file_size += out.size();
+    blocks.push_back(b);
+
+    open_first += count;
+    open_block.clear();
+    open_offsets.clear();
+    return true;
+}
+
+const uint8_t* ColdStore::Line(size_t index) const {
+    if (index >= open_first) return open_block.data() + open_offsets[index - open_first];
+
+    size_t bi = std::upper_bound(blocks.begin(), blocks.end(), index,
+                                 [](size_t line, const Block& b) { return line < b.first_line; }) -
+                blocks.begin() - 1;
+    const Block& b = blocks[bi];
+
+    CachedBlock* slot = nullptr;
+    for (auto& c : block_cache) {
+        if (c.store == id && c.generation == generation && c.block == bi) slot = &c;
+    }
+    if (!slot) {
+        // Replace the entry not used last; a hit in slot 1 is swapped to the front.
+        slot = &block_cache[1];
+        slot->data.resize(b.raw_bytes);
+        const uint8_t* src = view + b.offset;
+        bool good = b.packed_bytes == b.raw_bytes ? (memcpy(slot->data.data(), src, b.raw_bytes), true)
+                                                  : decompress(src, b.packed_bytes, slot->data.data(), b.raw_bytes);
+        // A corrupt block reads as empty lines rather than garbage.
+        if (!good) std::fill(slot->data.begin(), slot->data.end(), 0);
+        slot->store = id;
+        slot->generation = generation;
+        slot->block = good ? bi : ~(size_t)0;
+    }
+    if (slot != &block_cache[0]) std::swap(block_cache[0], block_cache[1]);
+    const uint8_t* data = block_cache[0].data.data();
+    uint32_t off;
+    memcpy(&off, data + (1 + (index - b.first_line)) * sizeof(uint32_t), sizeof(off));
+    return data + off;
+}
@@ -0,0 +1,90 @@
+#include "CommandIndex.h"
+#include <algorithm>
+
+void CommandIndex::Mark(char kind, uint64_t line, int col, int exit_code) {
+    if (kind == 'A') {
+        while (!entries.empty() && entries.back().prompt >= line) entries.pop_back();
+        Entry e;
+        e.prompt = line;
+        entries.push_back(e);
+        return;
+    }
+    // Shells that skip A still get an entry for the command.
+    if (entries.empty() || entries.back().prompt > line) {
+        while (!entries.empty() && entries.back().prompt > line) entries.pop_back();
+        Entry e;
+        e.prompt = line;
+        entries.push_back(e);
+    }
+    Entry& e = entries.back();
+    switch (kind) {
+    case 'B':
+        e.input = line;
+        break;
+    case 'C':
+        e.output = line;
+        break;
+    case 'D':
+        // D normally comes at the start of a fresh line; otherwise output ended mid-line.
+        e.end = col > 0 ? line + 1 : line;
+        e.exit_code = exit_code;
+        break;
+    }
+}
+
+void CommandIndex::Trim(uint64_t first_line) {
+    while (!entries.empty() && entries.front().prompt < first_line) entries.pop_front();
+}
+
+void CommandIndex::Remap(const std::function<uint64_t(uint64_t)>& map) {
+    auto remap = [&](uint64_t& line) {
+        if (line != kNoLine) line = map(line);
+    };
+    std::deque<Entry> kept;
+    for (Entry e : entries) {
+        remap(e.prompt);
+        if (e.prompt == kNoLine || (!kept.empty() && e.prompt <= kept.back().prompt)) continue;
+        remap(e.input);
+        remap(e.output);
+        remap(e.end);
+        kept.push_back(e);
+    }
+    entries.swap(kept);
+}
+
+bool CommandIndex::Output(size_t i, uint64_t& begin, uint64_t& end) const {
+    const Entry& e = entries[i];
+    if (e.output == kNoLine) return false;
+    begin = e.output;
+    // Without a D, the next prompt ends the output.
+    end = e.end != kNoLine ? e.end : i + 1 < entries.size() ? entries[i + 1].prompt : kNoLine;
+    end = std::max(end, begin);
+    return true;
+}
+
+bool CommandIndex::LastWithOutput(size_t& i) const {
+    // Usually the newest entry is the prompt now waiting, and the one before it ran.
+    for (size_t k = entries.size(); k-- > 0;) {
+        if (entries[k].output != kNoLine) {
+            i = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CommandIndex::Before(uint64_t line, size_t& i) const {
+    auto it = std::lower_bound(entries.begin(), entries.end(), line,
+                               [](const Entry& e, uint64_t l) { return e.prompt < l; });
+    if (it == entries.begin()) return false;
+    i = (size_t)(it - entries.begin()) - 1;
+    return true;
+}
+
+bool CommandIndex::After(uint64_t line, size_t& i) const {
+    auto it = std::upper_bound(entries.begin(), entries.end(), line,
+                               [](uint64_t l, const Entry& e) { return l < e.prompt; });
+    if (it == entries.end()) return false;
+    i = (size_t)(it - entries.begin());
+    return true;
+}
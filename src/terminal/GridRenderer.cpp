@@ -0,0 +1,198 @@
+#include "GridRenderer.h"
+#include <imgui_internal.h>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Matches the old per-run threshold: near-black backgrounds are left to the window fill.
+bool is_dark(ImU32 col) {
+    return ((col >> IM_COL32_R_SHIFT) & 0xFF) < 16 && ((col >> IM_COL32_G_SHIFT) & 0xFF) < 16 &&
+           ((col >> IM_COL32_B_SHIFT) & 0xFF) < 16;
+}
+
+ImWchar to_wchar(uint32_t cp) {
+    return cp > IM_UNICODE_CODEPOINT_MAX ? (ImWchar)IM_UNICODE_CODEPOINT_INVALID : (ImWchar)cp;
+}
+
+} // namespace
+
+void GridRenderer::BeginFrame() {
+    ImFontBaked* b = ImGui::GetFontBaked();
+    float size = ImGui::GetFontSize();
+    if (b != baked) {
+        baked = b;
+        atlas_tex_id = -1;
+    }
+    float old_w = cell_w, old_h = cell_h, old_scale = scale;
+    scale = size / baked->Size;
+    cell_h = ImGui::GetTextLineHeightWithSpacing();
+    if (atlas_changed()) refresh_ascii();
+    cell_w = baked->FindGlyph('M')->AdvanceX * scale;
+    underline_y = IM_TRUNC(size) - 1.0f;
+    if (cell_w != old_w || cell_h != old_h || scale != old_scale) epoch++;
+}
+
+bool GridRenderer::atlas_changed() const {
+    ImFontAtlas* atlas = ImGui::GetIO().Fonts;
+    return atlas->TexData->UniqueID != atlas_tex_id || atlas->TexUvScale.x != atlas_uv_scale.x ||
+           atlas->TexUvScale.y != atlas_uv_scale.y;
+}
+
+void GridRenderer::refresh_ascii() {
+    // Load first: adding glyphs can repack the atlas and move the ones already seen.
+    for (ImWchar c = 32; c < 128; ++c) baked->FindGlyph(c);
+    ImFontAtlas* atlas = ImGui::GetIO().Fonts;
+    atlas_tex_id = atlas->TexData->UniqueID;
+    atlas_uv_scale = atlas->TexUvScale;
+    for (ImWchar c = 0; c < 128; ++c) ascii[c] = c < 32 ? Glyph() : lookup(c);
+    epoch++;
+}
+
+GridRenderer::Glyph GridRenderer::lookup(uint32_t codepoint) {
+    // Copy out immediately; glyph pointers do not survive the baked font growing.
+    const ImFontGlyph* g = baked->FindGlyph(to_wchar(codepoint));
+    Glyph out;
+    if (!g || !g->Visible) return out;
+    out.x0 = g->X0 * scale;
+    out.y0 = g->Y0 * scale;
+    out.x1 = g->X1 * scale;
+    out.y1 = g->Y1 * scale;
+    out.u0 = g->U0;
+    out.v0 = g->V0;
+    out.u1 = g->U1;
+    out.v1 = g->V1;
+    out.visible = true;
+    return out;
+}
+
+void GridRenderer::DrawRow(ImDrawList* dl, ImVec2 pos, const TermCell* cells, int count) {
+    if (count <= 0) return;
+
+    // Resolve uncached glyphs before reserving vertices: loading one may swap the
+    // atlas texture, which must not happen with a half-written reservation.
+    for (int i = 0; i < count; ++i) {
+        uint32_t cp = cells[i].codepoint;
+        if (cp >= 128 && cp != (uint32_t)-1) baked->FindGlyph(to_wchar(cp));
+    }
+    if (atlas_changed()) refresh_ascii();
+
+    pos.x = IM_TRUNC(pos.x);
+    pos.y = IM_TRUNC(pos.y);
+    const ImVec2 white = dl->_Data->TexUvWhitePixel;
+
+    // At most one background, one glyph and one underline quad per cell.
+    const int max_quads = count * 3;
+    dl->PrimReserve(max_quads * 6, max_quads * 4);
+    int quads = 0;
+
+    // Backgrounds, merged into runs of equal color.
+    for (int i = 0; i < count;) {
+        const TermCell& c = cells[i];
+        ImU32 bg = c.reverse ? c.fg : c.bg;
+        int j = i + 1;
+        for (; j < count; ++j) {
+            const TermCell& n = cells[j];
+            if ((n.reverse ? n.fg : n.bg) != bg) break;
+        }
+        if (!is_dark(bg)) {
+            dl->PrimRectUV(ImVec2(pos.x + i * cell_w, pos.y), ImVec2(pos.x + j * cell_w, pos.y + cell_h), white, white, bg);
+            quads++;
+        }
+        i = j;
+    }
+
+    // Glyphs and underlines.
+    int ul_start = -1;
+    ImU32 ul_col = 0;
+    for (int i = 0; i <= count; ++i) {
+        const TermCell* c = i < count ? &cells[i] : nullptr;
+        ImU32 fg = c ? (c->reverse ? c->bg : c->fg) : 0;
+        bool underline = c && c->underline;
+        if (ul_start >= 0 && (!underline || fg != ul_col)) {
+            float y = pos.y + underline_y;
+            dl->PrimRectUV(ImVec2(pos.x + ul_start * cell_w, y), ImVec2(pos.x + i * cell_w, y + 1.0f), white, white, ul_col);
+            quads++;
+            ul_start = -1;
+        }
+        if (!c) break;
+        if (underline && ul_start < 0) {
+            ul_start = i;
+            ul_col = fg;
+        }
+
+        uint32_t cp = c->codepoint;
+        if (cp == (uint32_t)-1 || cp == 0 || cp == ' ') continue;
+        Glyph g = cp < 128 ? ascii[cp] : lookup(cp);
+        if (!g.visible) continue;
+        float x = pos.x + i * cell_w;
+        dl->PrimRectUV(ImVec2(x + g.x0, pos.y + g.y0), ImVec2(x + g.x1, pos.y + g.y1), ImVec2(g.u0, g.v0), ImVec2(g.u1, g.v1), fg);
+        quads++;
+    }
+
+    dl->PrimUnreserve((max_quads - quads) * 6, (max_quads - quads) * 4);
+}
+
+void GridRenderer::ReserveRowCache(int rows) {
+    size_t want = (size_t)std::max(rows, 1) * 2;
+    if (row_cache.size() < want) row_cache.resize(want);
+}
+
+void GridRenderer::DrawRowCached(ImDrawList* dl, ImVec2 pos, const TermCell* cells, int count, uint64_t key,
+                                 uint64_t slot) {
+    if (key == 0 || row_cache.empty()) {
+        DrawRow(dl, pos, cells, count);
+        return;
+    }
+    CachedRow& row = row_cache[slot % row_cache.size()];
+    pos.x = IM_TRUNC(pos.x);
+    pos.y = IM_TRUNC(pos.y);
+
+    if (row.key == key && row.epoch == epoch && !atlas_changed()) {
+        int nv = (int)row.vtx.size();
+        int ni = (int)row.idx.size();
+        if (nv == 0) return;
+        dl->PrimReserve(ni, nv);
+        // Read after reserving: a reservation can start a new vertex offset.
+        unsigned int base = dl->_VtxCurrentIdx;
+        float dx = pos.x - row.origin.x;
+        float dy = pos.y - row.origin.y;
+        if (dx == 0.0f && dy == 0.0f) {
+            memcpy(dl->_VtxWritePtr, row.vtx.data(), nv * sizeof(ImDrawVert));
+        } else {
+            // Both origins are whole pixels, so a shifted row lands where a rebuild would.
+            for (int i = 0; i < nv; ++i) {
+                ImDrawVert v = row.vtx[i];
+                v.pos.x += dx;
+                v.pos.y += dy;
+                dl->_VtxWritePtr[i] = v;
+            }
+        }
+        for (int i = 0; i < ni; ++i) dl->_IdxWritePtr[i] = (ImDrawIdx)(base + row.idx[i]);
+        dl->_VtxWritePtr += nv;
+        dl->_IdxWritePtr += ni;
+        dl->_VtxCurrentIdx += nv;
+        return;
+    }
+
+    // Miss: draw as usual and keep a copy of what was written.
+    unsigned int vtx_offset = dl->_CmdHeader.VtxOffset;
+    unsigned int base = dl->_VtxCurrentIdx;
+    int vtx_start = dl->VtxBuffer.Size;
+    int idx_start = dl->IdxBuffer.Size;
+    DrawRow(dl, pos, cells, count);
+    row.key = 0;
+    // A row that started a new vertex offset has indices on another base; leave it uncached.
+    if (dl->_CmdHeader.VtxOffset != vtx_offset) return;
+    size_t nv = dl->VtxBuffer.Size - vtx_start;
+    size_t ni = dl->IdxBuffer.Size - idx_start;
+    // Grow with headroom: rows that fill up a little at a time would reallocate every frame.
+    if (row.vtx.capacity() < nv) row.vtx.reserve(nv + nv / 2);
+    if (row.idx.capacity() < ni) row.idx.reserve(ni + ni / 2);
+    row.vtx.assign(dl->VtxBuffer.Data + vtx_start, dl->VtxBuffer.Data + dl->VtxBuffer.Size);
+    row.idx.resize(ni);
+    for (size_t i = 0; i < row.idx.size(); ++i) row.idx[i] = (ImDrawIdx)(dl->IdxBuffer.Data[idx_start + i] - base);
+    row.key = key;
+    row.epoch = epoch;
+    row.origin = pos;
+}
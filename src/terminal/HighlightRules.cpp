@@ -0,0 +1,193 @@
+#include "HighlightRules.h"
+#include "imgui.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <deque>
+#include <sstream>
+
+namespace {
+
+void append_utf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += (char)cp;
+    } else if (cp < 0x800) {
+        out += (char)(0xC0 | (cp >> 6));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += (char)(0xE0 | (cp >> 12));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else {
+        out += (char)(0xF0 | (cp >> 18));
+        out += (char)(0x80 | ((cp >> 12) & 0x3F));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+} // namespace
+
+std::vector<HighlightRule> HighlightRules::Parse(const std::string& text, std::string* errors) {
+    std::vector<HighlightRule> rules;
+    std::istringstream in(text);
+    std::string line;
+    int number = 0;
+    auto fail = [&](const char* why) {
+        if (errors) *errors += "line " + std::to_string(number) + ": " + why + "\n";
+    };
+    while (std::getline(in, line)) {
+        number++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line[start] == '#') continue;
+        size_t space = line.find_first_of(" \t", start);
+        size_t pattern = space == std::string::npos ? std::string::npos : line.find_first_not_of(" \t", space);
+        std::string color = line.substr(start, space == std::string::npos ? std::string::npos : space - start);
+        bool hex = color.size() == 6;
+        for (char c : color) hex = hex && isxdigit((unsigned char)c);
+        if (!hex || pattern == std::string::npos) {
+            fail("expected a RRGGBB color and a pattern");
+            continue;
+        }
+        unsigned long rgb = strtoul(color.c_str(), nullptr, 16);
+        HighlightRule rule;
+        rule.color = IM_COL32((rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF, 255);
+        rule.pattern = line.substr(pattern);
+        if (rule.pattern.size() > 2 && rule.pattern.front() == '/' && rule.pattern.back() == '/') {
+            rule.pattern = rule.pattern.substr(1, rule.pattern.size() - 2);
+            rule.regex = true;
+            try {
+                std::regex check(rule.pattern);
+            } catch (const std::regex_error&) {
+                fail("invalid regex");
+                continue;
+            }
+        }
+        rules.push_back(rule);
+    }
+    return rules;
+}
+
+void HighlightRules::Compile(const std::vector<HighlightRule>& rules) {
+    literals.clear();
+    regexes.clear();
+    std::fill(std::begin(byte_class), std::end(byte_class), 0);
+    classes = 1;
+    for (const HighlightRule& r : rules) {
+        if (r.regex || r.pattern.empty()) continue;
+        for (unsigned char b : r.pattern) {
+            if (!byte_class[b]) byte_class[b] = (uint16_t)classes++;
+        }
+    }
+
+    // The trie, then failure links breadth first, folding them into `next` so a
+    // scan takes one lookup per byte.
+    next.assign(classes, -1);
+    output.assign(1, -1);
+    int rank = 0;
+    for (const HighlightRule& r : rules) {
+        rank++;
+        if (r.regex) {
+            try {
+                regexes.push_back(Regex{std::regex(r.pattern, std::regex::optimize), r.color, rank});
+            } catch (const std::regex_error&) {
+                // Parse reports these; a rule that still got here is left out.
+            }
+            continue;
+        }
+        if (r.pattern.empty()) continue;
+        int32_t s = 0;
+        for (unsigned char b : r.pattern) {
+            int32_t& t = next[(size_t)s * classes + byte_class[b]];
+            if (t < 0) {
+                t = (int32_t)output.size();
+                output.push_back(-1);
+                next.resize(next.size() + classes, -1);
+            }
+            s = next[(size_t)s * classes + byte_class[b]];
+        }
+        // A repeated pattern keeps the first rule's color.
+        if (output[s] < 0) output[s] = (int32_t)literals.size();
+        literals.push_back(Literal{r.color, (int)r.pattern.size(), rank});
+    }
+
+    std::vector<int32_t> fail(output.size(), 0);
+    suffix.assign(output.size(), 0);
+    std::deque<int32_t> queue;
+    for (int c = 0; c < classes; ++c) {
+        int32_t& t = next[c];
+        if (t < 0) t = 0;
+        else queue.push_back(t);
+    }
+    while (!queue.empty()) {
+        int32_t s = queue.front();
+        queue.pop_front();
+        for (int c = 0; c < classes; ++c) {
+            int32_t& t = next[(size_t)s * classes + c];
+            int32_t via_fail = next[(size_t)fail[s] * classes + c];
+            if (t < 0) {
+                t = via_fail;
+                continue;
+            }
+            fail[t] = via_fail;
+            suffix[t] = output[via_fail] >= 0 ? via_fail : suffix[via_fail];
+            queue.push_back(t);
+        }
+    }
+}
+
+// Bytes [begin, end) of `text`, and the right half of a wide glyph ending there.
+void HighlightRules::paint(TermCell* cells, int count, size_t begin, size_t end, uint32_t color, int rank) {
+    if (!painted) {
+        owner.assign(count, INT_MAX);
+        painted = true;
+    }
+    int first = cell_of[begin];
+    int last = cell_of[end - 1];
+    if (last + 1 < count && cells[last + 1].codepoint == (uint32_t)-1) last++;
+    for (int c = first; c <= last; ++c) {
+        if (owner[c] < rank) continue;
+        owner[c] = rank;
+        cells[c].fg = color;
+        cells[c].default_fg = false;
+        cells[c].bold = true;
+    }
+}
+
+void HighlightRules::Apply(TermCell* cells, int count) {
+    if (Empty()) return;
+    text.clear();
+    cell_of.clear();
+    painted = false;
+    for (int i = 0; i < count; ++i) {
+        uint32_t cp = cells[i].codepoint;
+        if (cp == (uint32_t)-1) continue;
+        size_t before = text.size();
+        append_utf8(text, cp);
+        cell_of.insert(cell_of.end(), text.size() - before, i);
+    }
+
+    if (!literals.empty()) {
+        int32_t s = 0;
+        for (size_t i = 0; i < text.size(); ++i) {
+            s = next[(size_t)s * classes + byte_class[(unsigned char)text[i]]];
+            for (int32_t t = output[s] >= 0 ? s : suffix[s]; t > 0; t = suffix[t]) {
+                const Literal& lit = literals[output[t]];
+                paint(cells, count, i + 1 - lit.length, i + 1, lit.color, lit.rank);
+            }
+        }
+    }
+    for (const Regex& r : regexes) {
+        // Matching can throw (error_complexity, error_stack); this runs on the
+        // parser thread, so a rule that gives up just leaves the row uncolored.
+        try {
+            for (std::sregex_iterator it(text.begin(), text.end(), r.re), end; it != end; ++it) {
+                if (it->length() > 0)
+                    paint(cells, count, (size_t)it->position(), (size_t)(it->position() + it->length()), r.color, r.rank);
+            }
+        } catch (const std::regex_error&) {
+        }
+    }
+}
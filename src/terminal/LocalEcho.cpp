@@ -0,0 +1,173 @@
+#include "LocalEcho.h"
+#include <algorithm>
+#include <cctype>
+#include <string>
+
+namespace {
+
+// Predictions show once echoes take this long (seconds), like mosh's trigger.
+constexpr double kShowDelay = 0.03;
+// An unechoed key is given up on after a few round trips, within these bounds.
+constexpr double kMinTimeout = 0.5;
+constexpr double kMaxTimeout = 3.0;
+// Keys typed ahead of the echo; more than this is a paste or a stuck link.
+constexpr size_t kMaxKeys = 64;
+
+// Prompts whose input the remote end will not echo.
+bool hides_input(const TermCell* cells, int count) {
+    std::string text;
+    for (int i = 0; i < count; ++i) {
+        uint32_t cp = cells[i].codepoint;
+        text += cp < 0x80 ? (char)std::tolower((int)cp) : '?';
+    }
+    return text.find("password") != std::string::npos || text.find("passphrase") != std::string::npos;
+}
+
+} // namespace
+
+void LocalEcho::Char(const Screen& s, uint32_t ch, double now) {
+    // Only narrow characters: wide glyphs and combining marks move the cursor in ways not worth guessing.
+    if (ch < 0x20 || ch == 0x7F || ch >= 0x300 || !can_predict(s) || CursorCol() >= s.cols - 1) {
+        Barrier(s, false, now);
+        return;
+    }
+    int col = CursorCol();
+    TermCell cell = s.row(row)[col];
+    cell.codepoint = ch;
+    push(col, cell, col + 1, now);
+    keys.back().typed = true;
+}
+
+void LocalEcho::Backspace(const Screen& s, double now) {
+    if (!can_predict(s) || CursorCol() == 0 || s.row(row)[CursorCol() - 1].codepoint == (uint32_t)-1) {
+        Barrier(s, false, now);
+        return;
+    }
+    int col = CursorCol();
+    TermCell cell = s.row(row)[col - 1];
+    cell.codepoint = ' ';
+    push(col - 1, cell, col - 1, now);
+}
+
+void LocalEcho::Move(const Screen& s, int delta, double now) {
+    int col = can_predict(s) ? CursorCol() + delta : -1;
+    // Line editors only move right over text, so past its end the key is unpredictable.
+    if (col < 0 || col >= s.cols || (delta > 0 && s.row(row)[col - 1].codepoint == ' ')) {
+        Barrier(s, false, now);
+        return;
+    }
+    push(-1, TermCell(), col, now);
+}
+
+void LocalEcho::Barrier(const Screen& s, bool line_end, double now) {
+    blocked = true;
+    blocked_version = s.version;
+    blocked_row = s.cursor_row;
+    blocked_col = s.cursor_col;
+    blocked_since = now;
+    if (line_end) {
+        suspended = false;
+        echo_seen = false;
+    }
+}
+
+void LocalEcho::Clear() {
+    keys.clear();
+    overlay.clear();
+    showing = false;
+    blocked = false;
+    suspended = false;
+    echo_seen = false;
+}
+
+bool LocalEcho::can_predict(const Screen& s) {
+    if (s.altscreen || suspended || blocked || keys.size() >= kMaxKeys) return false;
+    if (keys.empty()) {
+        row = s.cursor_row;
+        start_col = s.cursor_col;
+    }
+    int col = CursorCol();
+    if (row < 0 || row >= s.rows || col < 0 || col >= s.cols) return false;
+    return !hides_input(s.row(row), col);
+}
+
+void LocalEcho::push(int col, const TermCell& cell, int cursor, double now) {
+    keys.push_back(Key{col, cell, cursor, now});
+    rebuild(now);
+}
+
+// True if the screen looks like the first `count` pending keys were applied:
+// the cursor is where they leave it and each cell they wrote last shows.
+bool LocalEcho::matches(const Screen& s, size_t count) const {
+    if (s.cursor_row != row || s.cursor_col != keys[count - 1].cursor) return false;
+    const TermCell* cells = s.row(row);
+    for (size_t i = 0; i < count; ++i) {
+        int col = keys[i].col;
+        if (col < 0) continue;
+        bool rewritten = false;
+        for (size_t j = i + 1; j < count && !rewritten; ++j) rewritten = keys[j].col == col;
+        // Only the character is compared: shells may color what they echo.
+        if (!rewritten && cells[col].codepoint != keys[i].cell.codepoint) return false;
+    }
+    return true;
+}
+
+double LocalEcho::timeout() const {
+    return srtt == 0.0 ? kMaxTimeout : std::clamp(srtt * 4, kMinTimeout, kMaxTimeout);
+}
+
+void LocalEcho::Reconcile(const Screen& s, double now) {
+    if (s.altscreen || row >= s.rows) keys.clear();
+
+    bool had_keys = !keys.empty();
+    if (had_keys) {
+        // The fewest keys that explain the screen: the echo may still be on its way for the rest.
+        size_t done = 0;
+        for (size_t k = 1; k <= keys.size() && !done; ++k) {
+            if (matches(s, k)) done = k;
+        }
+        if (done) {
+            double sample = now - keys[done - 1].sent;
+            srtt = srtt == 0.0 ? sample : srtt * 0.875 + sample * 0.125;
+            echo_seen = true;
+            keys.erase(keys.begin(), keys.begin() + done);
+            start_col = s.cursor_col;
+        } else if (s.cursor_row != row || s.cursor_col != start_col) {
+            // The screen went its own way; roll back every guess.
+            keys.clear();
+        } else if (now - keys.front().sent > timeout()) {
+            // Typing never came back: a password or a program reading raw keys.
+            // Stay off until the next line rather than show what it hides.
+            if (keys.front().typed) suspended = true;
+            keys.clear();
+        }
+    }
+
+    // After a barrier, wait until the screen reacts to it before guessing again.
+    // Pending keys are resolved first, so their own echo does not count.
+    if (blocked) {
+        if (had_keys) {
+            blocked_version = s.version;
+            blocked_row = s.cursor_row;
+            blocked_col = s.cursor_col;
+            blocked_since = now;
+        } else if (s.version != blocked_version || s.cursor_row != blocked_row || s.cursor_col != blocked_col ||
+                   now - blocked_since > timeout()) {
+            blocked = false;
+        }
+    }
+    rebuild(now);
+}
+
+void LocalEcho::rebuild(double now) {
+    overlay.clear();
+    for (const Key& k : keys) {
+        if (k.col < 0) continue;
+        auto it = std::find_if(overlay.begin(), overlay.end(), [&](const Cell& c) { return c.col == k.col; });
+        if (it != overlay.end()) it->cell = k.cell;
+        else overlay.push_back(Cell{k.col, k.cell});
+    }
+    // Nothing shows until one echo on this line came back, so a prompt that turns
+    // echo off never has its first keys drawn.
+    showing = !keys.empty() && echo_seen && (srtt >= kShowDelay || now - keys.front().sent >= kShowDelay);
+}
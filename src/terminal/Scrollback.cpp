@@ -0,0 +1,349 @@
+#include "Scrollback.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr int kMaxLineCells = 8192;
+// Expected lower bound on a record (header plus a short run); sizes the line index.
+// Lines smaller than this only mean the index, not the arena, triggers eviction.
+constexpr size_t kMinRecordBytes = 24;
+
+size_t align4(size_t n) { return (n + 3) & ~(size_t)3; }
+
+int utf8_encode(uint32_t cp, char* out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | ((cp >> 18) & 0x07));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+int utf8_length(uint32_t cp) {
+    if (cp < 0x80) return 1;
+    if (cp < 0x800) return 2;
+    if (cp < 0x10000) return 3;
+    return 4;
+}
+
+// Text is produced by utf8_encode, so sequences are known to be well formed.
+uint32_t utf8_decode(const char*& p) {
+    unsigned char c = (unsigned char)*p++;
+    if (c < 0x80) return c;
+    if ((c & 0xE0) == 0xC0) {
+        uint32_t cp = (c & 0x1F) << 6;
+        return cp | ((unsigned char)*p++ & 0x3F);
+    }
+    if ((c & 0xF0) == 0xE0) {
+        uint32_t cp = (c & 0x0F) << 12;
+        cp |= ((unsigned char)*p++ & 0x3F) << 6;
+        return cp | ((unsigned char)*p++ & 0x3F);
+    }
+    uint32_t cp = (c & 0x07) << 18;
+    cp |= ((unsigned char)*p++ & 0x3F) << 12;
+    cp |= ((unsigned char)*p++ & 0x3F) << 6;
+    return cp | ((unsigned char)*p++ & 0x3F);
+}
+
+bool is_blank(const TermCell& c) {
+    return (c.codepoint == ' ' || c.codepoint == 0) && c.default_bg && !c.reverse && !c.underline;
+}
+
+bool same_attrs(const TermCell& a, const TermCell& b) {
+    return a.fg == b.fg && a.bg == b.bg && a.bold == b.bold && a.underline == b.underline &&
+           a.reverse == b.reverse && a.default_fg == b.default_fg && a.default_bg == b.default_bg;
+}
+
+bool is_wide(const TermCell* cells, int i, int cols) {
+    return i + 1 < cols && cells[i + 1].codepoint == (uint32_t)-1;
+}
+
+} // namespace
+
+Scrollback::Scrollback(size_t budget_bytes) {
+    SetBudget(budget_bytes);
+}
+
+void Scrollback::SetBudget(size_t budget_bytes) {
+    budget = std::max(budget_bytes, kMinBudget);
+    // One index slot per smallest possible record; the slots are part of the budget.
+    index_capacity = budget / (kMinRecordBytes + sizeof(uint32_t));
+    arena_size = budget - index_capacity * sizeof(uint32_t);
+    // Default-initialised so untouched pages are never committed.
+    arena.reset(new uint8_t[arena_size]);
+    offsets.reset(new uint32_t[index_capacity]);
+    Clear();
+}
+
+void Scrollback::Clear() {
+    tail = 0;
+    count = 0;
+    head_off = 0;
+    evicted = 0;
+    if (cold) cold->Clear();
+}
+
+void Scrollback::EnableColdTier(bool enable, uint64_t limit_bytes) {
+    cold_limit = limit_bytes;
+    if (enable == (cold != nullptr)) return;
+    if (enable) {
+        cold.reset(new ColdStore());
+    } else {
+        evicted += cold->Size();
+        cold.reset();
+    }
+}
+
+size_t Scrollback::BytesUsed() const {
+    if (count == 0) return 0;
+    size_t oldest = offsets[tail];
+    if (head_off > oldest) return head_off - oldest;
+    return arena_size - oldest + head_off;
+}
+
+void Scrollback::evict_oldest() {
+    if (cold) {
+        if (cold->DiskBytes() >= cold_limit) {
+            evicted += cold->Size();
+            cold->Clear();
+        }
+        const Record* rec = reinterpret_cast<const Record*>(arena.get() + offsets[tail]);
+        size_t bytes = align4(sizeof(Record) + rec->run_count * sizeof(Run) + rec->text_bytes);
+        cold->Append(reinterpret_cast<const uint8_t*>(rec), bytes);
+        if (cold->Ok()) {
+            tail = (tail + 1) % index_capacity;
+            count--;
+            return;
+        }
+        // The disk tier failed: fall back to dropping lines, keeping numbering contiguous.
+        evicted += cold->Size();
+        cold.reset();
+    }
+    tail = (tail + 1) % index_capacity;
+    count--;
+    evicted++;
+}
+
+size_t Scrollback::allocate(size_t bytes) {
+    if (count == index_capacity) evict_oldest();
+    for (;;) {
+        if (count == 0) {
+            head_off = 0;
+            break;
+        }
+        size_t oldest = offsets[tail];
+        if (head_off > oldest) {
+            // Live data is [oldest, head_off); try the space after it, else wrap.
+            if (arena_size - head_off >= bytes) break;
+            head_off = 0;
+        } else {
+            // Wrapped: the only free space is [head_off, oldest).
+            if (oldest - head_off >= bytes) break;
+            evict_oldest();
+        }
+    }
+    size_t off = head_off;
+    head_off += bytes;
+    return off;
+}
+
+void Scrollback::Push(const TermCell* cells, int cols, bool continuation) {
+    cols = std::min(cols, kMaxLineCells);
+    int used = cols;
+    while (used > 0 && is_blank(cells[used - 1])) used--;
+
+    // First pass sizes the record so it can be written in place.
+    size_t text_bytes = 0;
+    size_t runs = 0;
+    const TermCell* run_start = nullptr;
+    bool run_wide = false;
+    for (int i = 0; i < used; ++i) {
+        const TermCell& c = cells[i];
+        if (c.codepoint == (uint32_t)-1) continue;
+        bool wide = is_wide(cells, i, cols);
+        if (!run_start || wide != run_wide || !same_attrs(c, *run_start)) {
+            runs++;
+            run_start = &c;
+            run_wide = wide;
+        }
+        text_bytes += utf8_length(c.codepoint == 0 ? ' ' : c.codepoint);
+    }
+
+    size_t bytes = align4(sizeof(Record) + runs * sizeof(Run) + text_bytes);
+    size_t off = allocate(bytes);
+    uint8_t* base = arena.get() + off;
+
+    Record* rec = reinterpret_cast<Record*>(base);
+    rec->text_bytes = (uint16_t)text_bytes;
+    rec->run_count = (uint16_t)runs;
+    rec->cols = (uint16_t)cols;
+    rec->flags = continuation ? LineContinuation : 0;
+
+    Run* run = reinterpret_cast<Run*>(base + sizeof(Record)) - 1;
+    char* text = reinterpret_cast<char*>(base + sizeof(Record) + runs * sizeof(Run));
+    run_start = nullptr;
+    for (int i = 0; i < used; ++i) {
+        const TermCell& c = cells[i];
+        if (c.codepoint == (uint32_t)-1) continue;
+        bool wide = is_wide(cells, i, cols);
+        if (!run_start || wide != run_wide || !same_attrs(c, *run_start)) {
+            ++run;
+            run->cells = 0;
+            run->flags = (c.bold ? RunBold : 0) | (c.underline ? RunUnderline : 0) |
+                         (c.reverse ? RunReverse : 0) | (wide ? RunWide : 0) |
+                         (c.default_fg ? RunDefaultFg : 0) | (c.default_bg ? RunDefaultBg : 0);
+            run->pad = 0;
+            run->fg = c.fg;
+            run->bg = c.bg;
+            run_start = &c;
+            run_wide = wide;
+        }
+        run->cells += wide ? 2 : 1;
+        text += utf8_encode(c.codepoint == 0 ? ' ' : c.codepoint, text);
+    }
+
+    offsets[(tail + count) % index_capacity] = (uint32_t)off;
+    count++;
+}
+
+bool Scrollback::PopBack(TermCell* cells, int cols, const TermCell& blank) {
+    if (count == 0) return false;
+    size_t last = count - 1;
+    const Record* rec = record(cold_lines() + last);
+    decode_into(rec, cells, cols, blank);
+    head_off = offsets[(tail + last) % index_capacity];
+    count--;
+    return true;
+}
+
+void Scrollback::Reflow(int new_cols, size_t max_lines, const TermCell& blank, std::vector<LineMove>* moves) {
+    if (new_cols < 2 || count == 0) return;
+    const size_t base = cold_lines();
+    const size_t total = base + count;
+    size_t start = total - std::min(max_lines, count);
+    while (start > base && Continuation(start)) start--;
+    const bool first_continues = Continuation(start);
+
+    // Join wrapped rows back into logical lines, without their trailing blanks.
+    std::vector<TermCell> cells;
+    std::vector<size_t> ends;
+    std::vector<uint64_t> starts;   // absolute index of each logical line's first row
+    std::vector<TermCell> row;
+    size_t line_begin = 0;
+    auto trim = [&]() {
+        while (cells.size() > line_begin && is_blank(cells.back())) cells.pop_back();
+    };
+    if (moves) starts.push_back(FirstIndex() + start);
+    for (size_t i = start; i < total; ++i) {
+        int w = Cols(i);
+        Decode(i, row, w, blank);
+        if (i > start && Continuation(i)) {
+            // A wide glyph that did not fit left a blank at the end of the previous row.
+            if (w > 1 && row[1].codepoint == (uint32_t)-1 && cells.size() > line_begin && is_blank(cells.back()))
+                cells.pop_back();
+        } else if (i > start) {
+            trim();
+            ends.push_back(cells.size());
+            line_begin = cells.size();
+            if (moves) starts.push_back(FirstIndex() + i);
+        }
+        cells.insert(cells.end(), row.begin(), row.end());
+    }
+    trim();
+    ends.push_back(cells.size());
+
+    // Drop the old rows; they are all in the ring, newest last.
+    head_off = offsets[(tail + (start - base)) % index_capacity];
+    count -= total - start;
+
+    row.assign(new_cols, blank);
+    size_t begin = 0;
+    bool continuation = first_continues;
+    for (size_t k = 0; k < ends.size(); ++k) {
+        size_t end = ends[k];
+        size_t p = begin;
+        if (moves) moves->push_back(LineMove{starts[k], FirstIndex() + Size()});
+        do {
+            int n = 0;
+            while (n < new_cols && p < end) {
+                bool wide = p + 1 < end && cells[p + 1].codepoint == (uint32_t)-1;
+                if (wide && n + 2 > new_cols) break;   // wrap a wide glyph whole
+                row[n++] = cells[p++];
+                if (wide) row[n++] = cells[p++];
+            }
+            std::fill(row.begin() + n, row.end(), blank);
+            Push(row.data(), new_cols, continuation);
+            continuation = true;
+        } while (p < end);
+        continuation = false;
+        begin = end;
+    }
+}
+
+const Scrollback::Record* Scrollback::record(size_t index) const {
+    size_t cold_count = cold_lines();
+    if (index < cold_count) return reinterpret_cast<const Record*>(cold->Line(index));
+    index -= cold_count;
+    return reinterpret_cast<const Record*>(arena.get() + offsets[(tail + index) % index_capacity]);
+}
+
+std::string_view Scrollback::Text(size_t index) const {
+    const Record* rec = record(index);
+    const char* text = reinterpret_cast<const char*>(rec + 1) + rec->run_count * sizeof(Run);
+    return std::string_view(text, rec->text_bytes);
+}
+
+int Scrollback::Cols(size_t index) const {
+    return record(index)->cols;
+}
+
+bool Scrollback::Continuation(size_t index) const {
+    return (record(index)->flags & LineContinuation) != 0;
+}
+
+void Scrollback::Decode(size_t index, std::vector<TermCell>& out, int width, const TermCell& blank) const {
+    out.resize(width);
+    decode_into(record(index), out.data(), width, blank);
+}
+
+void Scrollback::decode_into(const Record* rec, TermCell* out, int width, const TermCell& blank) const {
+    const Run* run = reinterpret_cast<const Run*>(rec + 1);
+    const char* text = reinterpret_cast<const char*>(run + rec->run_count);
+
+    int col = 0;
+    for (int r = 0; r < rec->run_count && col < width; ++r, ++run) {
+        TermCell cell;
+        cell.fg = run->fg;
+        cell.bg = run->bg;
+        cell.bold = (run->flags & RunBold) != 0;
+        cell.underline = (run->flags & RunUnderline) != 0;
+        cell.reverse = (run->flags & RunReverse) != 0;
+        cell.default_fg = (run->flags & RunDefaultFg) != 0;
+        cell.default_bg = (run->flags & RunDefaultBg) != 0;
+        bool wide = (run->flags & RunWide) != 0;
+        for (int n = 0; n < run->cells && col < width; n += wide ? 2 : 1) {
+            cell.codepoint = utf8_decode(text);
+            out[col++] = cell;
+            if (wide && col < width) {
+                out[col] = cell;
+                out[col++].codepoint = (uint32_t)-1;
+            }
+        }
+    }
+    std::fill(out + col, out + width, blank);
+}
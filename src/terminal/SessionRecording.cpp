@@ -0,0 +1,265 @@
+#include "SessionRecording.h"
+#include "Terminal.h"
+#include "Platform.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 'H', 'R', 'E', 'C', '0', '1', '\n'};
+enum RecordType : uint8_t { kData = 1, kResize = 2, kKeyframe = 3 };
+// Larger sizes mean a corrupt record; the index stops there.
+constexpr uint64_t kMaxDimension = 4096;
+
+uint64_t micros_now() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += (char)(v | 0x80);
+        v >>= 7;
+    }
+    out += (char)v;
+}
+
+bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+} // namespace
+
+SessionRecorder::~SessionRecorder() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_one();
+    if (writer.joinable()) writer.join();
+}
+
+bool SessionRecorder::Open(const std::string& path) {
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    out.write(kMagic, sizeof(kMagic));
+    ok = true;
+    last_us = micros_now();
+    writer = std::thread(&SessionRecorder::write_loop, this);
+    return true;
+}
+
+bool SessionRecorder::Ok() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return ok;
+}
+
+// With mutex held.
+void SessionRecorder::begin_record(uint8_t type) {
+    uint64_t now = micros_now();
+    pending += (char)type;
+    put_varint(pending, now - last_us);
+    last_us = now;
+}
+
+void SessionRecorder::Data(const char* data, size_t len) {
+    if (len == 0) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!ok) return;
+        if (pending.size() + len > kMaxPending) {
+            ok = false;
+            return;
+        }
+        begin_record(kData);
+        put_varint(pending, len);
+        pending.append(data, len);
+    }
+    cv.notify_one();
+}
+
+void SessionRecorder::Resize(uint64_t offset, int cols, int rows) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!ok) return;
+        begin_record(kResize);
+        put_varint(pending, offset);
+        put_varint(pending, (uint64_t)cols);
+        put_varint(pending, (uint64_t)rows);
+    }
+    cv.notify_one();
+}
+
+void SessionRecorder::Keyframe(uint64_t offset, int cols, int rows, const std::string& screen) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!ok) return;
+        if (pending.size() + screen.size() > kMaxPending) {
+            ok = false;
+            return;
+        }
+        begin_record(kKeyframe);
+        put_varint(pending, offset);
+        put_varint(pending, (uint64_t)cols);
+        put_varint(pending, (uint64_t)rows);
+        put_varint(pending, screen.size());
+        pending += screen;
+    }
+    cv.notify_one();
+}
+
+// Writes whole batches of records and flushes each, so a crash loses at most the
+// batch in flight; the player stops at a record cut off part way.
+void SessionRecorder::write_loop() {
+    std::string batch;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        cv.wait(lock, [&] { return stopping || !pending.empty(); });
+        if (pending.empty()) break;
+        batch.swap(pending);
+        lock.unlock();
+        out.write(batch.data(), (std::streamsize)batch.size());
+        out.flush();
+        bool good = (bool)out;
+        batch.clear();
+        lock.lock();
+        if (!good) ok = false;
+    }
+}
+
+SessionPlayer::~SessionPlayer() {
+    Close();
+}
+
+bool SessionPlayer::Open(const std::string& path) {
+    Close();
+    size_t size = 0;
+    view = static_cast<const uint8_t*>(Platform::MapFile(path, size));
+    view_size = size;
+    if (!view) return false;
+    if (!index()) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void SessionPlayer::Close() {
+    if (view) Platform::UnmapFile(view, view_size);
+    view = nullptr;
+    view_size = 0;
+    chunks.clear();
+    marks.clear();
+    chunk = chunk_pos = mark = 0;
+    clock_us = 0;
+    keyframe = nullptr;
+    keyframe_left = 0;
+}
+
+// One pass over the file. A truncated or damaged tail, as left by a crash while
+// recording, ends the index; everything before it stays playable.
+bool SessionPlayer::index() {
+    if (view_size < sizeof(kMagic) || memcmp(view, kMagic, sizeof(kMagic)) != 0) return false;
+    const uint8_t* p = view + sizeof(kMagic);
+    const uint8_t* end = view + view_size;
+    uint64_t time = 0;
+    uint64_t offset = 0;
+    while (p < end) {
+        uint8_t type = *p++;
+        uint64_t dt, len = 0;
+        if (!get_varint(p, end, dt)) break;
+        time += dt;
+        if (type == kData) {
+            if (!get_varint(p, end, len) || len > (uint64_t)(end - p)) break;
+            chunks.push_back(Chunk{time, offset, p, (size_t)len});
+            offset += len;
+        } else if (type == kResize || type == kKeyframe) {
+            uint64_t at, cols, rows;
+            if (!get_varint(p, end, at) || !get_varint(p, end, cols) || !get_varint(p, end, rows)) break;
+            if (cols == 0 || rows == 0 || cols > kMaxDimension || rows > kMaxDimension) break;
+            if (type == kKeyframe && (!get_varint(p, end, len) || len > (uint64_t)(end - p))) break;
+            marks.push_back(Mark{at, (int)cols, (int)rows, type == kKeyframe ? p : nullptr, (size_t)len, time});
+        } else {
+            break;
+        }
+        p += len;
+    }
+    // Keyframes and resizes are written by the parser, after the output they follow.
+    std::stable_sort(marks.begin(), marks.end(), [](const Mark& a, const Mark& b) { return a.offset < b.offset; });
+    return !chunks.empty() || !marks.empty();
+}
+
+double SessionPlayer::Duration() const {
+    return chunks.empty() ? 0.0 : chunks.back().time_us / 1e6;
+}
+
+double SessionPlayer::Position() const {
+    return std::min(clock_us / 1e6, Duration());
+}
+
+void SessionPlayer::Seek(Terminal& term, double seconds) {
+    uint64_t target = (uint64_t)(std::max(seconds, 0.0) * 1e6);
+    term.Reset();
+    chunk = chunk_pos = mark = 0;
+    keyframe = nullptr;
+    keyframe_left = 0;
+    // The latest keyframe at or before the target; marks are in stream order, so in
+    // time order too. The first keyframe, from when recording started, always counts.
+    for (size_t i = 0; i < marks.size() && (!keyframe || marks[i].time_us <= target); ++i) {
+        if (!marks[i].screen) continue;
+        keyframe = marks[i].screen;
+        keyframe_left = marks[i].len;
+        mark = i;
+    }
+    if (keyframe) {
+        const Mark& m = marks[mark++];
+        term.SetFixedSize(m.cols, m.rows);
+        auto it = std::upper_bound(chunks.begin(), chunks.end(), m.offset,
+                                   [](uint64_t off, const Chunk& c) { return off < c.offset; });
+        chunk = it == chunks.begin() ? 0 : (size_t)(it - chunks.begin()) - 1;
+        chunk_pos = chunk < chunks.size() ? (size_t)std::min<uint64_t>(m.offset - chunks[chunk].offset, chunks[chunk].len) : 0;
+    }
+    clock_us = target;
+}
+
+void SessionPlayer::Advance(Terminal& term, double dt) {
+    if (!view) return;
+    bool max_speed = speed <= 0.0 && !paused;
+    if (!paused && !max_speed) clock_us += (uint64_t)(dt * speed * 1e6);
+
+    // The keyframe a seek started from, before any output after it.
+    while (keyframe_left) {
+        size_t n = term.Feed(reinterpret_cast<const char*>(keyframe), keyframe_left);
+        if (n == 0) return;
+        keyframe += n;
+        keyframe_left -= n;
+    }
+
+    while (chunk < chunks.size()) {
+        const Chunk& c = chunks[chunk];
+        if (!max_speed && c.time_us > clock_us) break;
+        uint64_t at = c.offset + chunk_pos;
+        while (mark < marks.size() && marks[mark].offset <= at) {
+            term.SetFixedSize(marks[mark].cols, marks[mark].rows);
+            mark++;
+        }
+        // Stop at the next size change so it lands between the right bytes.
+        size_t len = c.len - chunk_pos;
+        if (mark < marks.size() && marks[mark].offset < at + len) len = (size_t)(marks[mark].offset - at);
+        size_t n = term.Feed(reinterpret_cast<const char*>(c.data) + chunk_pos, len);
+        chunk_pos += n;
+        if (n < len) break;     // the terminal is full; more next frame
+        if (chunk_pos == c.len) {
+            chunk++;
+            chunk_pos = 0;
+            if (max_speed) clock_us = std::max(clock_us, c.time_us);
+        }
+    }
+}
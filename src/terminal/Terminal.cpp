@@ -1,10 +1,38 @@
 #include "Terminal.h"
 #include <imgui_internal.h>
+#include <cctype>
 #include <cstring>
 #include <algorithm>
+#include <chrono>
 
 namespace {
 
+// Output faster than this switches to flood mode; measured over kRateWindow seconds.
+constexpr double kFloodBytesPerSec = 4.0 * (1 << 20);
+constexpr double kRateWindow = 0.25;
+// A window size must hold this long before the PTY and scrollback follow it.
+constexpr double kResizeDebounce = 0.15;
+// Newest scrollback lines re-wrapped when the width changes; older ones keep theirs.
+constexpr size_t kReflowLines = 5000;
+constexpr int kMinCols = 10;
+constexpr int kMinRows = 3;
+// The parser publishes a snapshot at least this often while input keeps coming,
+// and hands libvterm at most kParseChunk bytes between clock checks.
+constexpr auto kPublishInterval = std::chrono::milliseconds(8);
+constexpr size_t kParseChunk = 64u << 10;
+// Pushed lines held back while Render has history locked, before the parser waits.
+constexpr size_t kMaxStagedLines = 16384;
+// Longest a synchronized update may hold the screen if its end never arrives.
+constexpr auto kSyncTimeout = std::chrono::milliseconds(200);
+// A recording gets a keyframe after this much output or time, whichever comes first,
+// so a seek replays at most that much.
+constexpr uint64_t kKeyframeBytes = 1u << 20;
+constexpr auto kKeyframeInterval = std::chrono::seconds(10);
+
+double seconds_now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 std::string utf8_from_codepoint(uint32_t cp) {
     char buf[5] = {0};
     if (cp < 0x80) {
@@ -25,6 +53,13 @@ std::string utf8_from_codepoint(uint32_t cp) {
     return std::string(buf);
 }
 
+int utf8_length(uint32_t cp) {
+    if (cp < 0x80) return 1;
+    if (cp < 0x800) return 2;
+    if (cp < 0x10000) return 3;
+    return 4;
+}
+
 VTermModifier imgui_mods() {
     ImGuiIO& io = ImGui::GetIO();
     int mods = 0;
@@ -36,11 +71,21 @@ VTermModifier imgui_mods() {
 
 } // namespace
 
-Terminal::Terminal(int c, int r) : cols(c), rows(r) {
+Terminal::Terminal(int c, int r)
+    : vt_cols(c), vt_rows(r), cols(c), rows(r), pty_cols(c), pty_rows(r), sb_cols(c) {
+    scrollback.EnableColdTier(true);
     init_vterm();
+    fill_snapshot();
+    parser = std::thread(&Terminal::parse_loop, this);
 }
 
 Terminal::~Terminal() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        stopping = true;
+    }
+    wake_cv.notify_one();
+    parser.join();
     if (vt) vterm_free(vt);
 }
 
@@ -49,7 +94,7 @@ void Terminal::init_vterm() {
         vterm_free(vt);
         vt = nullptr;
     }
-    vt = vterm_new(rows, cols);
+    vt = vterm_new(vt_rows, vt_cols);
     vterm_set_utf8(vt, 1);
     vterm_output_set_callback(vt, &Terminal::write_callback, this);
 
@@ -62,95 +107,766 @@ void Terminal::init_vterm() {
     cbs.settermprop = &Terminal::settermprop_callback;
     cbs.bell = &Terminal::bell_callback;
     cbs.resize = &Terminal::resize_callback;
-    cbs.sb_pushline = &Terminal::sb_pushline_callback;
+    cbs.sb_pushline4 = &Terminal::sb_pushline_callback;
     cbs.sb_popline = &Terminal::sb_popline_callback;
     vterm_screen_set_callbacks(screen, &cbs, this);
+    static VTermStateFallbacks fallbacks;
+    fallbacks.osc = &Terminal::osc_callback;
+    vterm_screen_set_unrecognised_fallbacks(screen, &fallbacks, this);
+    // Continuation flags let scrollback be re-wrapped after a width change.
+    vterm_screen_callbacks_has_pushline4(screen);
+    vterm_screen_enable_reflow(screen, true);
+    // Per-cell damage is delivered before libvterm moves its buffer, which keeps the
+    // model exact; the merged modes report stale coordinates across scrolls.
+    vterm_screen_set_damage_merge(screen, VTERM_DAMAGE_CELL);
     vterm_screen_enable_altscreen(screen, 1);
+    refresh_palette();
+    reset_grid();
     vterm_screen_reset(screen, 1);
 }
 
+// Must run after any palette or default color change: cells hold resolved colors.
+void Terminal::refresh_palette() {
+    for (int i = 0; i < 256; ++i) {
+        VTermColor c;
+        vterm_state_get_palette_color(state, i, &c);
+        vterm_screen_convert_color_to_rgb(screen, &c);
+        palette[i] = IM_COL32(c.rgb.red, c.rgb.green, c.rgb.blue, 255);
+    }
+    sb_generation++;
+    if (!grid.empty()) fetch_cells(VTermRect{0, vt_rows, 0, vt_cols});
+}
+
+void Terminal::reset_grid() {
+    grid.assign(vt_rows, Row());
+    for (auto& row : grid) row.cells.resize(vt_cols);
+    fetch_cells(VTermRect{0, vt_rows, 0, vt_cols});
+}
+
 void Terminal::Resize(int c, int r) {
+    c = std::max(c, kMinCols);
+    r = std::max(r, kMinRows);
+    if (c == cols && r == rows) return;
     cols = c;
     rows = r;
-    vterm_set_size(vt, rows, cols);
+    echo.Clear();
+    Command cmd(Command::Kind::Resize);
+    cmd.cols = c;
+    cmd.rows = r;
+    queue(std::move(cmd));
+    resize_settling = true;
+    resize_time = ImGui::GetTime();
+}
+
+void Terminal::SetFixedSize(int c, int r) {
+    fixed_size = c > 0 && r > 0;
+    if (fixed_size) Resize(c, r);
+}
+
+bool Terminal::TakePtyResize(int& out_cols, int& out_rows) {
+    if (resize_settling || (cols == pty_cols && rows == pty_rows)) return false;
+    pty_cols = out_cols = cols;
+    pty_rows = out_rows = rows;
+    return true;
+}
+
+// Cells that fit the scroll region, leaving room for its vertical scrollbar so
+// the width does not flip as the scrollbar comes and goes.
+bool Terminal::FitSize(ImVec2 size, int& out_cols, int& out_rows) const {
+    const ImGuiStyle& style = ImGui::GetStyle();
+    float w = size.x - style.WindowPadding.x * 2 - style.ScrollbarSize - style.ChildBorderSize * 2;
+    float h = size.y - style.WindowPadding.y * 2 - style.ChildBorderSize * 2;
+    if (w <= 0 || h <= 0 || grid_renderer.CellWidth() <= 0) return false;
+    out_cols = (int)(w / grid_renderer.CellWidth());
+    out_rows = (int)(h / grid_renderer.CellHeight());
+    return true;
+}
+
+void Terminal::fit_to_region(ImVec2 size) {
+    int c, r;
+    if (FitSize(size, c, r)) Resize(c, r);   // not when collapsed or a hidden dock tab
+}
+
+// libvterm reflows the live screen at once; scrollback is re-wrapped only when
+// the size stops changing.
+void Terminal::settle_resize() {
+    if (!resize_settling || ImGui::GetTime() - resize_time < kResizeDebounce) return;
+    resize_settling = false;
+    if (sb_cols == cols) return;
+    sb_cols = cols;
+    Command cmd(Command::Kind::Reflow);
+    cmd.cols = cols;
+    queue(std::move(cmd));
+    clear_selection();
+}
+
+size_t Terminal::Feed(const std::string& data) {
+    return Feed(data.data(), data.size());
+}
+
+size_t Terminal::Feed(const char* data, size_t len) {
+    size_t taken = 0;
+    while (taken < len) {
+        char* span;
+        size_t n = std::min(input.WriteSpan(&span), len - taken);
+        if (n == 0) break;
+        memcpy(span, data + taken, n);
+        input.Commit(n);
+        taken += n;
+    }
+    if (taken == 0) return 0;
+    fed_bytes += taken;
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        wake = true;
+    }
+    wake_cv.notify_one();
+    return taken;
 }
 
-void Terminal::Feed(const std::string& data) {
-    vterm_input_write(vt, data.data(), data.size());
+void Terminal::DroppedOutput() {
+    queue(Command(Command::Kind::Cancel));
+}
+
+void Terminal::Sync() {
+    uint64_t want_commands;
+    {
+        std::lock_guard<std::mutex> lock(cmd_mutex);
+        want_commands = queued_commands;
+    }
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    idle_cv.wait(lock, [&] { return published_bytes >= fed_bytes && published_commands >= want_commands; });
+}
+
+std::string Terminal::ScreenText() {
+    std::lock_guard<std::mutex> lock(sb_mutex);
+    take_snapshot();
+    std::string out;
+    for (const Line& line : shown().lines) {
+        for (const Cell& c : line.cells) out += cell_text(c);
+        out += '\n';
+    }
+    return out;
+}
+
+void Terminal::SetNotifyCallback(std::function<void()> cb) {
+    std::lock_guard<std::mutex> lock(notify_mutex);
+    notify_callback = std::move(cb);
+}
+
+void Terminal::notify() {
+    std::lock_guard<std::mutex> lock(notify_mutex);
+    if (notify_callback) notify_callback();
 }
 
 std::string Terminal::ConsumeOutgoing() {
-    std::string out = outgoing;
-    outgoing.clear();
+    std::lock_guard<std::mutex> lock(out_mutex);
+    std::string out;
+    out.swap(outgoing);
     return out;
 }
 
 void Terminal::Reset() {
-    scrollback.clear();
-    vterm_screen_reset(screen, 1);
+    echo.Clear();
+    queue(Command(Command::Kind::Reset));
 }
 
 void Terminal::ClearScrollback() {
-    scrollback.clear();
+    queue(Command(Command::Kind::ClearScrollback));
+}
+
+void Terminal::SetScrollbackBudget(size_t bytes) {
+    Command cmd(Command::Kind::SetBudget);
+    cmd.bytes = bytes;
+    queue(std::move(cmd));
+}
+
+// Compiled here so the parser only swaps the automaton in.
+void Terminal::SetHighlightRules(const std::vector<HighlightRule>& rules) {
+    Command cmd(Command::Kind::Highlight);
+    if (!rules.empty()) {
+        cmd.highlights = std::make_shared<HighlightRules>();
+        cmd.highlights->Compile(rules);
+    }
+    queue(std::move(cmd));
+}
+
+// The parser starts the recording once it has parsed everything fed so far, so the
+// first keyframe and the first recorded byte meet.
+bool Terminal::StartRecording(const std::string& path) {
+    auto rec = std::make_shared<SessionRecorder>();
+    if (!rec->Open(path)) return false;
+    recorder = rec;
+    Command cmd(Command::Kind::Record);
+    cmd.recorder = std::move(rec);
+    queue(std::move(cmd));
+    return true;
+}
+
+void Terminal::StopRecording() {
+    if (!recorder) return;
+    recorder.reset();
+    queue(Command(Command::Kind::Record));
+}
+
+bool Terminal::WantsFrame() const {
+    // Keep frames coming while flooding so the indicator updates and the mode can end,
+    // and while a resize settles so the debounced work runs.
+    return (ready.load(std::memory_order_acquire) & kFreshSnapshot) || search.Scanning() ||
+           snapshots[front].flooding || resize_settling;
+}
+
+void Terminal::queue(Command cmd) {
+    cmd.mark = fed_bytes;
+    {
+        std::lock_guard<std::mutex> lock(cmd_mutex);
+        commands.push_back(std::move(cmd));
+        queued_commands++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        wake = true;
+    }
+    wake_cv.notify_one();
 }
 
-// Callbacks
+// Parser thread: wait for input or commands, run them, publish, repeat. While
+// flooding it also wakes once per rate window so the mode can end, and during
+// a synchronized update at its deadline.
+void Terminal::parse_loop() {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            auto woken = [&] { return wake || stopping || !input.Empty(); };
+            if (synchronized) wake_cv.wait_until(lock, sync_deadline, woken);
+            else if (flooding) wake_cv.wait_for(lock, std::chrono::duration<double>(kRateWindow), woken);
+            else wake_cv.wait(lock, woken);
+            if (stopping) return;
+            wake = false;
+        }
+        take_commands();
+        run_due_commands();
+        parse_input();
+        run_due_commands();
+        update_throughput();
+        publish(input.Empty());
+        record_keyframe(false);
+        if (published || wrote) notify();
+        published = false;
+        wrote = false;
+    }
+}
+
+void Terminal::take_commands() {
+    {
+        std::lock_guard<std::mutex> lock(cmd_mutex);
+        taken_commands.swap(commands);
+    }
+    for (Command& cmd : taken_commands) {
+        switch (cmd.kind) {
+        case Command::Kind::Key:
+        case Command::Kind::Char:
+        case Command::Kind::Paste:
+            run_command(cmd);
+            break;
+        default:
+            pending.push_back(std::move(cmd));
+            break;
+        }
+    }
+    taken_commands.clear();
+    // Ctrl+C during a flood: drop the queued output as well, so the interrupt
+    // shows up now instead of after megabytes that were already in flight.
+    if (interrupted && flooding) drop_input(input.Size());
+    interrupted = false;
+}
+
+// Skip `n` bytes of input unparsed. The gap may split a sequence, so the parser is
+// cancelled (CAN) back to the ground state; a UTF-8 character cut short becomes
+// one U+FFFD.
+void Terminal::drop_input(uint64_t n) {
+    input.Consume((size_t)n);
+    parsed_bytes += n;
+    record("\x18", 1);
+    vterm_input_write(vt, "\x18", 1);
+}
+
+// The recording holds what the parser saw, so a replay never shows dropped output.
+void Terminal::record(const char* data, size_t len) {
+    if (!recording) return;
+    recording->Data(data, len);
+    recorded_bytes += len;
+}
+
+void Terminal::run_due_commands() {
+    // Output fed before a reset belongs to the old session and is dropped unparsed.
+    while (!pending.empty() && (parsed_bytes >= pending.front().mark || pending.front().kind == Command::Kind::Reset)) {
+        run_command(pending.front());
+        pending.pop_front();
+    }
+}
+
+void Terminal::run_command(Command& cmd) {
+    switch (cmd.kind) {
+    case Command::Kind::Key:
+        vterm_keyboard_key(vt, cmd.key, cmd.mods);
+        break;
+    case Command::Kind::Char:
+        vterm_keyboard_unichar(vt, cmd.ch, cmd.mods);
+        break;
+    case Command::Kind::Paste:
+        // The clipboard goes upstream, wrapped in bracketed-paste markers when enabled.
+        vterm_keyboard_start_paste(vt);
+        {
+            std::lock_guard<std::mutex> lock(out_mutex);
+            outgoing += cmd.text;
+        }
+        wrote = true;
+        vterm_keyboard_end_paste(vt);
+        break;
+    case Command::Kind::Resize: {
+        // Growing the screen pops lines back out of history, so hold it and
+        // publish before letting Render see the shorter scrollback.
+        std::lock_guard<std::mutex> lock(sb_mutex);
+        flush_staged();
+        uint64_t old_top = screen_top();
+        VTermPos pos;
+        vterm_state_get_cursorpos(state, &pos);
+        vterm_set_size(vt, cmd.rows, cmd.cols);
+        remap_marks(old_top, old_top + pos.row);
+        fill_snapshot();
+        if (recording) recording->Resize(recorded_bytes, vt_cols, vt_rows);
+        break;
+    }
+    case Command::Kind::Reset: {
+        drop_input(std::min<uint64_t>(cmd.mark > parsed_bytes ? cmd.mark - parsed_bytes : 0, input.Size()));
+        synchronized = false;   // the reset ends it; nothing to present early
+        std::lock_guard<std::mutex> lock(sb_mutex);
+        staged.clear();
+        staged_cells.clear();
+        staged_marks.clear();
+        scrollback.Clear();
+        command_index.Clear();
+        sb_generation++;
+        vterm_screen_reset(screen, 1);
+        record("\x1b" "c", 2);   // RIS, so playback from before here resets too
+        fill_snapshot();
+        record_keyframe(true);
+        break;
+    }
+    case Command::Kind::ClearScrollback: {
+        std::lock_guard<std::mutex> lock(sb_mutex);
+        flush_marks();
+        uint64_t old_top = screen_top();
+        staged.clear();
+        staged_cells.clear();
+        scrollback.Clear();
+        // Numbering restarts at the top of the screen.
+        command_index.Remap([&](uint64_t l) { return l < old_top ? CommandIndex::kNoLine : l - old_top; });
+        sb_generation++;
+        fill_snapshot();
+        break;
+    }
+    case Command::Kind::SetBudget: {
+        std::lock_guard<std::mutex> lock(sb_mutex);
+        flush_marks();
+        uint64_t old_top = screen_top();
+        staged.clear();
+        staged_cells.clear();
+        scrollback.SetBudget((size_t)cmd.bytes);
+        command_index.Remap([&](uint64_t l) { return l < old_top ? CommandIndex::kNoLine : l - old_top; });
+        sb_generation++;
+        fill_snapshot();
+        break;
+    }
+    case Command::Kind::Reflow: {
+        std::lock_guard<std::mutex> lock(sb_mutex);
+        flush_staged();
+        uint64_t old_top = screen_top();
+        std::vector<Scrollback::LineMove> moves;
+        scrollback.Reflow(cmd.cols, kReflowLines, blank_cell(), &moves);
+        if (!moves.empty()) {
+            // Marks follow the first row of their logical line; the screen moves with the end of history.
+            uint64_t new_top = screen_top();
+            command_index.Remap([&](uint64_t l) {
+                if (l >= old_top) return l - old_top + new_top;
+                if (l < moves.front().from) return l;
+                auto it = std::upper_bound(moves.begin(), moves.end(), l,
+                                           [](uint64_t v, const Scrollback::LineMove& m) { return v < m.from; });
+                return (it - 1)->to;
+            });
+            command_index.Trim(scrollback.FirstIndex());
+        }
+        sb_generation++;
+        fill_snapshot();
+        break;
+    }
+    case Command::Kind::Record:
+        // The old recorder, if this was its last owner, finishes writing as it goes.
+        recording = std::move(cmd.recorder);
+        recorded_bytes = 0;
+        record_keyframe(true);
+        break;
+    case Command::Kind::Highlight:
+        highlights = std::move(cmd.highlights);
+        grid_stale = true;      // recolor the whole screen with the next snapshot
+        changed = true;
+        break;
+    case Command::Kind::Cancel:
+        drop_input(0);          // the gap is before Feed; nothing queued to skip
+        break;
+    }
+    done_commands++;
+}
+
+// Parse for up to one publish interval, leaving the rest for the next batch, and
+// stop at the mark of the next screen command so it sees the screen it was meant for.
+void Terminal::parse_input() {
+    auto deadline = std::chrono::steady_clock::now() + kPublishInterval;
+    const char* data;
+    while (size_t len = input.ReadSpan(&data)) {
+        len = std::min(len, kParseChunk);
+        if (!pending.empty()) len = (size_t)std::min<uint64_t>(len, pending.front().mark - parsed_bytes);
+        if (len == 0) break;
+        rate_bytes += len;
+        // Enter flood mode as soon as the current window is over the rate, not at its end.
+        if (!flooding && rate_bytes >= kFloodBytesPerSec * kRateWindow) flooding = true;
+        if (flooding) flood_bytes += len;
+        record(data, len);
+        vterm_input_write(vt, data, len);
+        input.Consume(len);
+        parsed_bytes += len;
+        changed = true;
+        if (std::chrono::steady_clock::now() >= deadline) break;
+    }
+}
+
+void Terminal::update_throughput() {
+    double now = seconds_now();
+    double elapsed = now - rate_start;
+    if (elapsed < kRateWindow) return;
+    throughput = rate_bytes / elapsed;
+    if (flooding) changed = true;   // the indicator shows the new rate
+    flooding = throughput >= kFloodBytesPerSec;
+    if (!flooding) flood_bytes = 0;
+    rate_bytes = 0;
+    rate_start = now;
+}
+
+// Hand the current screen to Render. Unless `wait` is set or too many lines are
+// staged, a frame in progress is not waited for; the next batch tries again.
+void Terminal::publish(bool wait) {
+    if (synchronized) {
+        // Never ended, or streaming more than a redraw: show what there is.
+        if (staged.size() < kMaxStagedLines && std::chrono::steady_clock::now() < sync_deadline) return;
+        synchronized = false;
+    }
+    if (changed || !staged.empty()) {
+        std::unique_lock<std::mutex> lock(sb_mutex, std::defer_lock);
+        if (wait || staged.size() >= kMaxStagedLines) lock.lock();
+        else if (!lock.try_lock()) return;
+        fill_snapshot();
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        published_bytes = parsed_bytes;
+        published_commands = done_commands;
+    }
+    idle_cv.notify_all();
+}
+
+// With sb_mutex held (or before the parser starts): move staged lines into
+// scrollback, copy changed rows into the back snapshot and swap it into `ready`.
+void Terminal::fill_snapshot() {
+    if (grid_stale) {
+        fetch_cells(VTermRect{0, vt_rows, 0, vt_cols});
+        grid_stale = false;
+    }
+    flush_staged();
+    Snapshot& s = snapshots[back];
+    s.lines.resize(grid.size());
+    for (size_t r = 0; r < grid.size(); ++r) {
+        Line& line = s.lines[r];
+        if (line.version == grid[r].version) continue;
+        line.cells = grid[r].cells;
+        if (highlights) highlights->Apply(line.cells.data(), (int)line.cells.size());
+        line.version = grid[r].version;
+        line.dirty = true;
+    }
+    s.cols = vt_cols;
+    s.rows = vt_rows;
+    s.cursor = cursor_pos;
+    s.cursor_visible = cursor_visible;
+    s.altscreen = altscreen;
+    s.blank = blank_cell();
+    s.grid_version = grid_version;
+    s.sb_generation = sb_generation;
+    s.flooding = flooding;
+    s.throughput = throughput;
+    s.flood_bytes = flood_bytes;
+    back = ready.exchange(back | kFreshSnapshot, std::memory_order_acq_rel) & ~kFreshSnapshot;
+    changed = false;
+    published = true;
+}
+
+// After each batch while recording. Seeking in a replay starts from the latest
+// keyframe, so they must land between batches, where the grid matches parsed_bytes.
+void Terminal::record_keyframe(bool force) {
+    if (!recording) return;
+    uint64_t offset = recorded_bytes;
+    auto now = std::chrono::steady_clock::now();
+    if (!force && (offset == keyframe_offset ||
+                   (offset - keyframe_offset < kKeyframeBytes && now < keyframe_time + kKeyframeInterval)))
+        return;
+    if (grid_stale) {
+        fetch_cells(VTermRect{0, vt_rows, 0, vt_cols});
+        grid_stale = false;
+    }
+    recording->Keyframe(offset, vt_cols, vt_rows, screen_keyframe());
+    keyframe_offset = offset;
+    keyframe_time = now;
+}
+
+// The grid as output that repaints it on a reset terminal of the same size: each
+// row's cells with their colors and attributes, then the cursor. Trailing blanks
+// in the default colors are left to the clear. An alternate screen is painted on
+// the alternate screen, so the application leaving it behaves as it did live.
+std::string Terminal::screen_keyframe() const {
+    std::string out = altscreen ? "\x1b[?1049h" : "";
+    out += "\x1b[0m\x1b[H\x1b[2J";
+    char buf[64];
+    for (int r = 0; r < vt_rows && r < (int)grid.size(); ++r) {
+        const std::vector<Cell>& cells = grid[r].cells;
+        int end = (int)cells.size();
+        while (end > 0) {
+            const Cell& c = cells[end - 1];
+            if (c.codepoint != ' ' || !c.default_bg || c.reverse || c.underline) break;
+            end--;
+        }
+        if (end == 0) continue;
+        snprintf(buf, sizeof(buf), "\x1b[%d;1H", r + 1);
+        out += buf;
+        const Cell* pen = nullptr;
+        for (int i = 0; i < end; ++i) {
+            const Cell& c = cells[i];
+            if (c.codepoint == (uint32_t)-1) continue;
+            if (!pen || c.fg != pen->fg || c.bg != pen->bg || c.bold != pen->bold || c.underline != pen->underline ||
+                c.reverse != pen->reverse || c.default_fg != pen->default_fg || c.default_bg != pen->default_bg) {
+                out += "\x1b[0";
+                if (c.bold) out += ";1";
+                if (c.underline) out += ";4";
+                if (c.reverse) out += ";7";
+                if (!c.default_fg) {
+                    snprintf(buf, sizeof(buf), ";38;2;%u;%u;%u", (c.fg >> IM_COL32_R_SHIFT) & 0xFF,
+                             (c.fg >> IM_COL32_G_SHIFT) & 0xFF, (c.fg >> IM_COL32_B_SHIFT) & 0xFF);
+                    out += buf;
+                }
+                if (!c.default_bg) {
+                    snprintf(buf, sizeof(buf), ";48;2;%u;%u;%u", (c.bg >> IM_COL32_R_SHIFT) & 0xFF,
+                             (c.bg >> IM_COL32_G_SHIFT) & 0xFF, (c.bg >> IM_COL32_B_SHIFT) & 0xFF);
+                    out += buf;
+                }
+                out += 'm';
+                pen = &c;
+            }
+            out += utf8_from_codepoint(c.codepoint ? c.codepoint : ' ');
+        }
+    }
+    snprintf(buf, sizeof(buf), "\x1b[0m\x1b[%d;%dH\x1b[?25%c", cursor_pos.row + 1, cursor_pos.col + 1,
+             cursor_visible ? 'h' : 'l');
+    out += buf;
+    return out;
+}
+
+void Terminal::flush_staged() {
+    flush_marks();
+    const Cell* cells = staged_cells.data();
+    for (const StagedLine& line : staged) {
+        scrollback.Push(cells, line.cols, line.continuation);
+        cells += line.cols;
+    }
+    if (!staged.empty()) command_index.Trim(scrollback.FirstIndex());
+    staged.clear();
+    staged_cells.clear();
+}
+
+// With sb_mutex held. Staged marks are numbered with the staged lines counted,
+// so they stay valid whether or not those lines are in scrollback yet.
+void Terminal::flush_marks() {
+    for (const StagedMark& m : staged_marks) command_index.Mark(m.kind, m.line, m.col, m.exit_code);
+    staged_marks.clear();
+}
+
+// Absolute line number of the top screen row, on the parser side.
+uint64_t Terminal::screen_top() const {
+    return scrollback.FirstIndex() + scrollback.Size() + staged.size();
+}
+
+// After a resize, with sb_mutex held. libvterm re-wraps the screen without saying
+// where rows went, so marks on it keep their distance from the cursor row, which
+// holds the line being typed and the prompts just above it.
+void Terminal::remap_marks(uint64_t old_top, uint64_t old_cursor) {
+    VTermPos pos;
+    vterm_state_get_cursorpos(state, &pos);
+    uint64_t new_cursor = screen_top() + pos.row;
+    command_index.Remap([&](uint64_t l) {
+        if (l < old_top) return l;
+        if (new_cursor + l < old_cursor) return CommandIndex::kNoLine;
+        return new_cursor + l - old_cursor;
+    });
+    command_index.Trim(scrollback.FirstIndex());
+}
+
+// Callbacks, all on the parser thread
 void Terminal::write_callback(const char* s, size_t len, void* user) {
     auto* t = static_cast<Terminal*>(user);
+    if (memchr(s, '\x03', len)) t->interrupted = true;
+    std::lock_guard<std::mutex> lock(t->out_mutex);
     t->outgoing.append(s, len);
+    t->wrote = true;
+}
+
+// While flooding or inside a synchronized update, screen changes only mark the
+// grid stale; the next snapshot refetches it once. Scrollback does not depend on
+// the grid, so pushed lines stay exact.
+int Terminal::damage_callback(VTermRect rect, void* user) {
+    auto* t = static_cast<Terminal*>(user);
+    if (t->flooding || t->synchronized) t->grid_stale = true;
+    else t->fetch_cells(rect);
+    return 1;
+}
+
+int Terminal::moverect_callback(VTermRect dest, VTermRect src, void* user) {
+    auto* t = static_cast<Terminal*>(user);
+    if (t->flooding || t->synchronized) t->grid_stale = true;
+    else t->move_cells(dest, src);
+    return 1;
+}
+
+int Terminal::movecursor_callback(VTermPos pos, VTermPos, int, void* user) {
+    auto* t = static_cast<Terminal*>(user);
+    t->cursor_pos = pos;
+    t->changed = true;
+    return 1;
+}
+
+int Terminal::settermprop_callback(VTermProp prop, VTermValue* val, void* user) {
+    auto* t = static_cast<Terminal*>(user);
+    t->changed = true;
+    if (prop == VTERM_PROP_CURSORVISIBLE) t->cursor_visible = val->boolean;
+    if (prop == VTERM_PROP_ALTSCREEN) t->altscreen = val->boolean;
+    if (prop == VTERM_PROP_SYNCHRONIZED) {
+        if (val->boolean && !t->synchronized) {
+            t->synchronized = true;
+            t->sync_deadline = std::chrono::steady_clock::now() + kSyncTimeout;
+        } else if (!val->boolean && t->synchronized) {
+            // Present the finished frame now: the rest of this batch may already
+            // begin the next update, which would hold it back again.
+            t->synchronized = false;
+            t->publish(true);
+        }
+    }
+    return 1;
 }
 
-int Terminal::damage_callback(VTermRect, void*) { return 1; }
-int Terminal::moverect_callback(VTermRect, VTermRect, void*) { return 1; }
-int Terminal::movecursor_callback(VTermPos, VTermPos, int, void*) { return 1; }
-int Terminal::settermprop_callback(VTermProp, VTermValue*, void*) { return 1; }
 int Terminal::bell_callback(void*) { return 1; }
+
 int Terminal::resize_callback(int rows, int cols, void* user) {
     auto* t = static_cast<Terminal*>(user);
-    t->rows = rows;
-    t->cols = cols;
+    t->vt_rows = rows;
+    t->vt_cols = cols;
+    t->grid.resize(rows);
+    for (auto& row : t->grid) row.cells.resize(cols);
+    t->sb_generation++;
+    // libvterm emits its full-screen damage before this callback, while the grid
+    // still had the old size, so refetch everything here.
+    t->fetch_cells(VTermRect{0, rows, 0, cols});
+    return 1;
+}
+
+int Terminal::sb_pushline_callback(int cols, const VTermScreenCell* cells, bool continuation, void* user) {
+    auto* t = static_cast<Terminal*>(user);
+    size_t at = t->staged_cells.size();
+    t->staged_cells.resize(at + cols);
+    for (int i = 0; i < cols; ++i) t->staged_cells[at + i] = t->make_cell(cells[i]);
+    if (t->highlights) t->highlights->Apply(&t->staged_cells[at], cols);
+    t->staged.push_back(StagedLine{cols, continuation});
     return 1;
 }
 
-int Terminal::sb_pushline_callback(int cols, const VTermScreenCell* cells, void* user) {
+// Only reached from vterm_set_size, which run_commands calls with sb_mutex held.
+int Terminal::sb_popline_callback(int cols, VTermScreenCell* cells, void* user) {
     auto* t = static_cast<Terminal*>(user);
-    Line line;
-    line.cells.reserve(cols);
+    t->flush_staged();
+    t->sb_cells.resize(cols);
+    if (!t->scrollback.PopBack(t->sb_cells.data(), cols, t->blank_cell())) return 0;
+    t->sb_generation++;
     for (int i = 0; i < cols; ++i) {
-        Cell c;
-        c.codepoint = cells[i].chars[0];
-        c.fg = cells[i].fg;
-        c.bg = cells[i].bg;
-        c.bold = cells[i].attrs.bold;
-        c.underline = cells[i].attrs.underline != 0;
-        c.reverse = cells[i].attrs.reverse;
-        line.cells.push_back(c);
-    }
-    t->scrollback.push_back(std::move(line));
-    if (t->scrollback.size() > t->max_scrollback) t->scrollback.pop_front();
+        const Cell& c = t->sb_cells[i];
+        VTermScreenCell& out = cells[i];
+        out = VTermScreenCell{};
+        out.chars[0] = c.codepoint;
+        out.width = (i + 1 < cols && t->sb_cells[i + 1].codepoint == (uint32_t)-1) ? 2 : 1;
+        out.attrs.bold = c.bold;
+        out.attrs.underline = c.underline ? VTERM_UNDERLINE_SINGLE : VTERM_UNDERLINE_OFF;
+        out.attrs.reverse = c.reverse;
+        // Popped lines come back as plain RGB; only the default markers are kept.
+        vterm_color_rgb(&out.fg, (c.fg >> IM_COL32_R_SHIFT) & 0xFF, (c.fg >> IM_COL32_G_SHIFT) & 0xFF, (c.fg >> IM_COL32_B_SHIFT) & 0xFF);
+        vterm_color_rgb(&out.bg, (c.bg >> IM_COL32_R_SHIFT) & 0xFF, (c.bg >> IM_COL32_G_SHIFT) & 0xFF, (c.bg >> IM_COL32_B_SHIFT) & 0xFF);
+        if (c.default_fg) out.fg.type |= VTERM_COLOR_DEFAULT_FG;
+        if (c.default_bg) out.bg.type |= VTERM_COLOR_DEFAULT_BG;
+    }
     return 1;
 }
 
-int Terminal::sb_popline_callback(int, VTermScreenCell*, void* user) {
+// Shell integration (OSC 133): A starts the prompt, B the command line, C the
+// output, and D;status ends the command. Marks in the alternate screen are ignored.
+int Terminal::osc_callback(int command, VTermStringFragment frag, void* user) {
+    if (command != 133) return 0;
     auto* t = static_cast<Terminal*>(user);
-    if (!t->scrollback.empty()) t->scrollback.pop_front();
+    if (frag.initial) t->osc_text.clear();
+    if (t->osc_text.size() < 64) t->osc_text.append(frag.str, frag.len);
+    if (!frag.final) return 1;
+    const std::string& s = t->osc_text;
+    if (s.empty() || s[0] < 'A' || s[0] > 'D' || t->altscreen) return 1;
+    int exit_code = -1;
+    if (s[0] == 'D' && s.size() > 2 && s[1] == ';' && isdigit((unsigned char)s[2])) exit_code = atoi(s.c_str() + 2);
+    VTermPos pos;
+    vterm_state_get_cursorpos(t->state, &pos);
+    t->staged_marks.push_back(StagedMark{s[0], t->screen_top() + pos.row, pos.col, exit_code});
+    t->changed = true;
     return 1;
 }
 
-ImVec4 Terminal::color_to_vec(const VTermColor& c_in) const {
-    VTermColor c = c_in;
-    vterm_screen_convert_color_to_rgb(screen, &c);
-    return ImVec4(c.rgb.red / 255.0f, c.rgb.green / 255.0f, c.rgb.blue / 255.0f, 1.0f);
+uint32_t Terminal::resolve_color(const VTermColor& c) const {
+    if (VTERM_COLOR_IS_INDEXED(&c)) return palette[c.indexed.idx];
+    return IM_COL32(c.rgb.red, c.rgb.green, c.rgb.blue, 255);
+}
+
+Terminal::Cell Terminal::make_cell(const VTermScreenCell& cell) const {
+    Cell out;
+    out.codepoint = cell.chars[0] ? cell.chars[0] : ' ';
+    out.fg = resolve_color(cell.fg);
+    out.bg = resolve_color(cell.bg);
+    out.bold = cell.attrs.bold;
+    out.underline = cell.attrs.underline != 0;
+    out.reverse = cell.attrs.reverse;
+    out.default_fg = VTERM_COLOR_IS_DEFAULT_FG(&cell.fg);
+    out.default_bg = VTERM_COLOR_IS_DEFAULT_BG(&cell.bg);
+    return out;
 }
 
-static bool colors_equal(VTermScreen* screen, const VTermColor& a_in, const VTermColor& b_in) {
-    VTermColor a = a_in, b = b_in;
-    vterm_screen_convert_color_to_rgb(screen, &a);
-    vterm_screen_convert_color_to_rgb(screen, &b);
-    return a.rgb.red == b.rgb.red && a.rgb.green == b.rgb.green && a.rgb.blue == b.rgb.blue;
+Terminal::Cell Terminal::blank_cell() const {
+    VTermColor fg, bg;
+    vterm_state_get_default_colors(state, &fg, &bg);
+    Cell c;
+    c.fg = resolve_color(fg);
+    c.bg = resolve_color(bg);
+    return c;
 }
 
 std::string Terminal::cell_text(const Cell& cell) const {
+    if (cell.codepoint == (uint32_t)-1) return ""; // right half of a wide glyph
     if (cell.codepoint == 0 || cell.codepoint == 0x20) return " ";
     return utf8_from_codepoint(cell.codepoint);
 }
@@ -165,96 +881,143 @@ void Terminal::clear_selection() {
     sel_end.reset();
 }
 
-int Terminal::point_to_col(const std::string& text, float x) const {
-    float acc = 0.0f;
-    for (size_t i = 0; i < text.size();) {
-        unsigned char c = text[i];
-        size_t adv = 1;
-        if ((c & 0xE0) == 0xC0) adv = 2;
-        else if ((c & 0xF0) == 0xE0) adv = 3;
-        else if ((c & 0xF8) == 0xF0) adv = 4;
-        float w = ImGui::CalcTextSize(text.substr(i, adv).c_str()).x;
-        if (acc + w * 0.5f >= x) return (int)i;
-        acc += w;
-        i += adv;
-    }
-    return (int)text.size();
-}
-
-static int trimmed_len(const std::string& s) {
-    int len = (int)s.size();
-    while (len > 0 && std::isspace((unsigned char)s[len-1])) len--;
+// Cells up to and including the last non-blank one.
+static int trimmed_cells(const std::vector<TermCell>& cells) {
+    int len = (int)cells.size();
+    while (len > 0 && (cells[len - 1].codepoint == ' ' || cells[len - 1].codepoint == 0)) len--;
     return len;
 }
 
-Terminal::SelPos Terminal::mouse_to_pos(const ImVec2& mouse, const ImVec2& origin, float line_height, const std::vector<std::string>& lines) const {
+// Selection columns are cell boundaries: column N sits between cells N-1 and N.
+Terminal::SelPos Terminal::mouse_to_pos(const ImVec2& mouse, const ImVec2& origin, float line_height) {
     SelPos pos;
-    int line = (int)((mouse.y - origin.y) / line_height);
-    line = std::clamp(line, 0, (int)lines.size() - 1);
-    pos.line = line;
-    float relx = mouse.x - origin.x;
-    int col = point_to_col(lines[line], relx);
-    int maxcol = trimmed_len(lines[line]);
-    pos.col = std::clamp(col, 0, maxcol);
+    pos.line = std::clamp((int)((mouse.y - origin.y) / line_height), 0, std::max(total_lines() - 1, 0));
+    float x = (mouse.x - origin.x) / grid_renderer.CellWidth();
+    int col = std::clamp((int)(x + 0.5f), 0, shown().cols);
+    // Never split a wide glyph; snap to the edge nearer the pointer.
+    const Line& line = line_at(pos.line);
+    if (col > 0 && col < (int)line.cells.size() && line.cells[col].codepoint == (uint32_t)-1)
+        col += x < col ? -1 : 1;
+    pos.col = col;
     return pos;
 }
 
-void Terminal::copy_selection_to_clipboard(const ImVec2& origin, float line_height, const std::vector<std::string>& lines) {
-    if (!has_selection() || lines.empty()) return;
+void Terminal::copy_selection_to_clipboard() {
+    if (!has_selection() || total_lines() == 0) return;
     SelPos a = sel_start.value();
     SelPos b = sel_end.value();
     if (b.line < a.line || (b.line == a.line && b.col < a.col)) std::swap(a, b);
-    int start_line = std::clamp(a.line, 0, (int)lines.size() - 1);
-    int end_line = std::clamp(b.line, 0, (int)lines.size() - 1);
+    int start_line = std::clamp(a.line, 0, total_lines() - 1);
+    int end_line = std::clamp(b.line, 0, total_lines() - 1);
     std::string clip;
     for (int i = start_line; i <= end_line; ++i) {
-        const std::string& l = lines[i];
-        int start_col = (i == start_line) ? a.col : 0;
-        int end_col = (i == end_line) ? b.col : (int)l.size();
-        start_col = std::clamp(start_col, 0, (int)l.size());
-        end_col = std::clamp(end_col, 0, (int)l.size());
-        if (start_col < end_col) clip.append(l.substr(start_col, end_col - start_col));
+        const Line& line = line_at(i);
+        int maxc = trimmed_cells(line.cells);
+        int start_col = std::min((i == start_line) ? a.col : 0, maxc);
+        int end_col = std::min((i == end_line) ? b.col : maxc, maxc);
+        for (int c = start_col; c < end_col; ++c) clip += cell_text(line.cells[c]);
         if (i != end_line) clip.push_back('\n');
     }
     ImGui::SetClipboardText(clip.c_str());
 }
 
-void Terminal::rebuild_screen(std::vector<Line>& lines_out, std::vector<std::string>& plain_out) {
-    lines_out.clear();
-    plain_out.clear();
-    // Start with scrollback
-    for (const auto& l : scrollback) {
-        lines_out.push_back(l);
-        std::string p;
-        for (const auto& c : l.cells) p += cell_text(c);
-        plain_out.push_back(std::move(p));
-    }
-
-    // Current screen
-    int cur_rows, cur_cols;
-    vterm_get_size(vt, &cur_rows, &cur_cols);
-    vterm_state_get_cursorpos(state, &cursor_pos);
-    Line line;
-    line.cells.resize(cur_cols);
-    for (int r = 0; r < cur_rows; ++r) {
-        for (int c = 0; c < cur_cols; ++c) {
-            VTermPos pos{ (int)r, (int)c };
+void Terminal::fetch_cells(const VTermRect& rect) {
+    int end_row = std::min(rect.end_row, (int)grid.size());
+    for (int r = std::max(rect.start_row, 0); r < end_row; ++r) {
+        Row& row = grid[r];
+        int end_col = std::min(rect.end_col, (int)row.cells.size());
+        for (int c = std::max(rect.start_col, 0); c < end_col; ++c) {
             VTermScreenCell cell;
-            vterm_screen_get_cell(screen, pos, &cell);
-            Cell out;
-            out.codepoint = cell.chars[0] ? cell.chars[0] : ' ';
-            out.fg = cell.fg;
-            out.bg = cell.bg;
-            out.bold = cell.attrs.bold;
-            out.underline = cell.attrs.underline != 0;
-            out.reverse = cell.attrs.reverse;
-            line.cells[c] = out;
+            vterm_screen_get_cell(screen, VTermPos{r, c}, &cell);
+            row.cells[c] = make_cell(cell);
         }
-        lines_out.push_back(line);
-        std::string p;
-        for (const auto& c : line.cells) p += cell_text(c);
-        plain_out.push_back(std::move(p));
+        row.version = ++row_clock;
     }
+    grid_version++;
+    changed = true;
+}
+
+void Terminal::move_cells(const VTermRect& dest, const VTermRect& src) {
+    grid_version++;
+    changed = true;
+    int downward = src.start_row - dest.start_row;
+    int ncols = src.end_col - src.start_col;
+    bool full_width = dest.start_col == 0 && src.start_col == 0 && ncols == vt_cols;
+
+    // Same traversal order as libvterm's moverect_internal so overlapping moves are safe.
+    int init_row, test_row, inc_row;
+    if (downward < 0) {
+        init_row = dest.end_row - 1;
+        test_row = dest.start_row - 1;
+        inc_row = -1;
+    } else {
+        init_row = dest.start_row;
+        test_row = dest.end_row;
+        inc_row = +1;
+    }
+
+    for (int row = init_row; row != test_row; row += inc_row) {
+        Row& to = grid[row];
+        Row& from = grid[row + downward];
+        if (full_width) {
+            // Whole rows: swap storage instead of copying cells. The source row is
+            // either overwritten by a later move or erased and refetched via damage.
+            // The version travels with the cells, so snapshots copy neither again.
+            std::swap(to.cells, from.cells);
+            std::swap(to.version, from.version);
+        } else {
+            std::copy_n(from.cells.begin() + src.start_col, ncols, to.cells.begin() + dest.start_col);
+            to.version = ++row_clock;
+        }
+    }
+}
+
+int Terminal::total_lines() const {
+    return (int)(scrollback.Size() + snapshots[front].lines.size());
+}
+
+// Every row lookup (drawing, selection, copy, search highlights) goes through
+// here. Scrollback rows are decoded on first use and kept while they stay in
+// the row cache; a reference is valid until another row maps to the same slot.
+const Terminal::Line& Terminal::line_at(int index) {
+    const Snapshot& view = shown();
+    int sb_size = (int)scrollback.Size();
+    if (index >= sb_size) return view.lines[index - sb_size];
+    if (row_cache.empty()) reserve_row_cache(view.rows);
+    uint64_t line = scrollback.FirstIndex() + index;
+    CachedRow& slot = row_cache[line % row_cache.size()];
+    if (slot.line != line) {
+        scrollback.Decode(index, slot.row.cells, view.cols, view.blank);
+        slot.row.version = (1ull << 63) | ++decode_clock;
+        slot.line = line;
+    }
+    return slot.row;
+}
+
+// Room for the visible rows plus a screenful either side, so scrolling reuses rows.
+void Terminal::reserve_row_cache(int visible_rows) {
+    size_t want = (size_t)std::max(visible_rows, 1) * 3;
+    if (row_cache.size() >= want) return;
+    row_cache.assign(want, CachedRow());
+}
+
+// Runs when the snapshot's sb_generation moves, i.e. decoded rows could differ for
+// the same line number: lines popped and re-pushed, history cleared, or the width
+// or default colors changed.
+void Terminal::invalidate_row_cache() {
+    for (auto& slot : row_cache) slot.line = ~0ull;
+}
+
+std::string_view Terminal::line_text(int index) {
+    int sb_size = (int)scrollback.Size();
+    if (index < sb_size) return scrollback.Text(index);
+    Line& line = shown().lines[index - sb_size];
+    if (line.dirty) {
+        line.text.clear();
+        for (const auto& c : line.cells) line.text += cell_text(c);
+        line.dirty = false;
+    }
+    return line.text;
 }
 
 void Terminal::handle_input() {
@@ -262,21 +1025,47 @@ void Terminal::handle_input() {
     VTermModifier mods = imgui_mods();
     bool ctrlDown = io.KeyCtrl;
 
+    LocalEcho::Screen screen = echo_screen();
+    double now = seconds_now();
+
     // Printable chars
     for (int i = 0; i < io.InputQueueCharacters.Size; ++i) {
         ImWchar c = io.InputQueueCharacters[i];
         if (c >= 0x20) {
-            vterm_keyboard_unichar(vt, c, mods);
+            if (mods & (VTERM_MOD_CTRL | VTERM_MOD_ALT)) echo.Barrier(screen, false, now);
+            else echo.Char(screen, c, now);
+            Command cmd(Command::Kind::Char);
+            cmd.ch = c;
+            cmd.mods = mods;
+            queue(std::move(cmd));
         }
     }
 
-    auto send_key = [&](VTermKey k) { vterm_keyboard_key(vt, k, mods); };
+    // Keys are encoded by libvterm on the parser thread, which owns its modes.
+    auto send_key = [&](VTermKey k) {
+        bool plain = (mods & ~VTERM_MOD_SHIFT) == 0;
+        if (plain && k == VTERM_KEY_BACKSPACE) echo.Backspace(screen, now);
+        else if (plain && (k == VTERM_KEY_LEFT || k == VTERM_KEY_RIGHT)) echo.Move(screen, k == VTERM_KEY_LEFT ? -1 : 1, now);
+        else echo.Barrier(screen, k == VTERM_KEY_ENTER, now);
+        Command cmd(Command::Kind::Key);
+        cmd.key = k;
+        cmd.mods = mods;
+        queue(std::move(cmd));
+    };
 
     if (ImGui::IsKeyPressed(ImGuiKey_Enter)) send_key(VTERM_KEY_ENTER);
     if (ImGui::IsKeyPressed(ImGuiKey_Backspace)) send_key(VTERM_KEY_BACKSPACE);
     if (ImGui::IsKeyPressed(ImGuiKey_Tab)) send_key(VTERM_KEY_TAB);
-    if (ImGui::IsKeyPressed(ImGuiKey_UpArrow)) send_key(VTERM_KEY_UP);
-    if (ImGui::IsKeyPressed(ImGuiKey_DownArrow)) send_key(VTERM_KEY_DOWN);
+    // Ctrl+Shift+Up/Down step between command prompts instead of going upstream.
+    bool command_jump = io.KeyCtrl && io.KeyShift;
+    if (ImGui::IsKeyPressed(ImGuiKey_UpArrow)) {
+        if (command_jump) jump_to_command(true);
+        else send_key(VTERM_KEY_UP);
+    }
+    if (ImGui::IsKeyPressed(ImGuiKey_DownArrow)) {
+        if (command_jump) jump_to_command(false);
+        else send_key(VTERM_KEY_DOWN);
+    }
     if (ImGui::IsKeyPressed(ImGuiKey_LeftArrow)) send_key(VTERM_KEY_LEFT);
     if (ImGui::IsKeyPressed(ImGuiKey_RightArrow)) send_key(VTERM_KEY_RIGHT);
     if (ImGui::IsKeyPressed(ImGuiKey_Home)) send_key(VTERM_KEY_HOME);
@@ -292,126 +1081,166 @@ void Terminal::handle_input() {
     }
 }
 
+LocalEcho::Screen Terminal::echo_screen() {
+    const Snapshot& view = shown();
+    LocalEcho::Screen s;
+    s.cols = view.cols;
+    s.rows = (int)view.lines.size();
+    s.cursor_row = view.cursor.row;
+    s.cursor_col = view.cursor.col;
+    s.altscreen = view.altscreen;
+    s.version = view.grid_version;
+    s.row = [&view](int r) { return view.lines[r].cells.data(); };
+    return s;
+}
+
+// Called with sb_mutex held, so history matches the snapshot picked up.
+void Terminal::take_snapshot() {
+    if (ready.load(std::memory_order_acquire) & kFreshSnapshot)
+        front = ready.exchange(front, std::memory_order_acq_rel) & ~kFreshSnapshot;
+    if (shown().sb_generation != seen_generation) {
+        seen_generation = shown().sb_generation;
+        invalidate_row_cache();
+        search.Restart();
+    }
+}
+
 void Terminal::Render() {
-    ImGui::PushStyleColor(ImGuiCol_ChildBg, ImVec4(0.05f,0.05f,0.05f,1.0f));
+    ImGuiIO& io = ImGui::GetIO();
+    // The parser only waits on this lock to publish; it never holds it while parsing.
+    std::lock_guard<std::mutex> history_lock(sb_mutex);
+    take_snapshot();
+    const Snapshot& view = shown();
+    echo.Reconcile(echo_screen(), seconds_now());
+    if (ImGui::IsWindowFocused(ImGuiFocusedFlags_RootAndChildWindows) && io.KeyCtrl && io.KeyShift &&
+        ImGui::IsKeyPressed(ImGuiKey_F)) {
+        find_open = true;
+        find_focus = true;
+    }
+    if (find_open) render_find_bar();
+
+    grid_renderer.BeginFrame();
     ImVec2 avail = ImGui::GetContentRegionAvail();
+    if (!fixed_size) fit_to_region(avail);
+    settle_resize();
+
+    ImGui::PushStyleColor(ImGuiCol_ChildBg, ImVec4(0.05f,0.05f,0.05f,1.0f));
     ImGui::BeginChild("scroll_region", ImVec2(avail.x, avail.y), true, ImGuiWindowFlags_HorizontalScrollbar);
 
     bool focused = ImGui::IsWindowFocused(ImGuiFocusedFlags_ChildWindows);
     if (focused) handle_input();
 
-    std::vector<Line> lines;
-    std::vector<std::string> plain;
-    rebuild_screen(lines, plain);
-    std::vector<int> trimmed;
-    trimmed.reserve(plain.size());
-    for (const auto& l : plain) trimmed.push_back(trimmed_len(l));
+    int line_count = total_lines();
 
     ImVec2 origin = ImGui::GetCursorScreenPos();
-    float line_height = ImGui::GetTextLineHeightWithSpacing();
-
-    // Draw lines
-    ImGuiListClipper clipper;
-    clipper.Begin((int)lines.size(), line_height);
-    while (clipper.Step()) {
-        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
-            ImGui::PushID(i);
-            float x_cursor = ImGui::GetCursorPosX();
-            const auto& line = lines[i];
-            size_t idx = 0;
-            while (idx < line.cells.size()) {
-                Cell base = line.cells[idx];
-                std::string text = cell_text(base);
-                size_t j = idx + 1;
-                for (; j < line.cells.size(); ++j) {
-                    const auto& c = line.cells[j];
-                    if (!colors_equal(screen, c.fg, base.fg) || !colors_equal(screen, c.bg, base.bg) ||
-                        c.bold != base.bold || c.reverse != base.reverse || c.underline != base.underline) break;
-                    text += cell_text(c);
-                }
-                ImVec4 fg = color_to_vec(base.reverse ? base.bg : base.fg);
-                ImVec4 bg = color_to_vec(base.reverse ? base.fg : base.bg);
-                ImVec2 pos = ImGui::GetCursorScreenPos();
-                ImVec2 size = ImGui::CalcTextSize(text.c_str());
-                if (bg.x > 0.06f || bg.y > 0.06f || bg.z > 0.06f) {
-                    ImGui::GetWindowDrawList()->AddRectFilled(pos, ImVec2(pos.x + size.x, pos.y + line_height), ImGui::ColorConvertFloat4ToU32(bg));
-                }
-                ImGui::PushStyleColor(ImGuiCol_Text, fg);
-                ImGui::TextUnformatted(text.c_str());
-                ImGui::PopStyleColor();
-                ImGui::SameLine(0,0);
-                idx = j;
+    float line_height = grid_renderer.CellHeight();
+
+    update_search();
+    bool jumped = scroll_to_line >= 0;
+    if (jumped) {
+        float margin = scroll_line_top ? 0.0f : ImGui::GetWindowHeight() * 0.5f;
+        ImGui::SetScrollY(std::max(0.0f, scroll_to_line * line_height - margin));
+        scroll_to_line = -1;
+        scroll_line_top = false;
+    }
+
+    // Draw only the rows intersecting the clip rect; a single Dummy sizes the scroll area.
+    ImDrawList* dl = ImGui::GetWindowDrawList();
+    int first = std::clamp((int)((dl->GetClipRectMin().y - origin.y) / line_height), 0, line_count);
+    int last = std::clamp((int)((dl->GetClipRectMax().y - origin.y) / line_height) + 1, first, line_count);
+    reserve_row_cache(last - first);
+    grid_renderer.ReserveRowCache(last - first);
+    // Rows whose version is unchanged since last frame are copied from the renderer's
+    // cache; cursor, selection and search highlights are drawn over them separately.
+    uint64_t first_line = scrollback.FirstIndex();
+    int echo_line = echo.Showing() ? (int)scrollback.Size() + echo.Row() : -1;
+    for (int i = first; i < last; ++i) {
+        const Line& line = line_at(i);
+        ImVec2 pos(origin.x, origin.y + i * line_height);
+        if (i == echo_line) {
+            // Predicted keys take the place of their cells, underlined until the echo confirms them.
+            echo_cells = line.cells;
+            for (const LocalEcho::Cell& p : echo.Cells()) {
+                if (p.col >= (int)echo_cells.size()) continue;
+                echo_cells[p.col] = p.cell;
+                echo_cells[p.col].underline = true;
             }
-            ImGui::NewLine();
-            ImGui::PopID();
+            grid_renderer.DrawRow(dl, pos, echo_cells.data(), (int)echo_cells.size());
+            continue;
         }
+        grid_renderer.DrawRowCached(dl, pos, line.cells.data(), (int)line.cells.size(), line.version, first_line + i);
     }
+    draw_search_highlights(dl, origin, first, last);
+    if (view.flooding) render_flood_indicator();
+    ImGui::Dummy(ImVec2(view.cols * grid_renderer.CellWidth(), line_count * line_height));
 
     // Selection handling
     bool hovered = ImGui::IsWindowHovered();
     if (hovered && ImGui::IsMouseClicked(0)) {
         clear_selection();
         selecting = true;
-        sel_start = mouse_to_pos(ImGui::GetIO().MousePos, origin, line_height, plain);
+        sel_start = mouse_to_pos(ImGui::GetIO().MousePos, origin, line_height);
         sel_end = sel_start;
     }
     if (selecting && ImGui::IsMouseDown(0)) {
-        sel_end = mouse_to_pos(ImGui::GetIO().MousePos, origin, line_height, plain);
+        sel_end = mouse_to_pos(ImGui::GetIO().MousePos, origin, line_height);
     } else if (selecting && ImGui::IsMouseReleased(0)) {
-        sel_end = mouse_to_pos(ImGui::GetIO().MousePos, origin, line_height, plain);
+        sel_end = mouse_to_pos(ImGui::GetIO().MousePos, origin, line_height);
         selecting = false;
     }
     if (has_selection()) {
         SelPos a = sel_start.value();
         SelPos b = sel_end.value();
         if (b.line < a.line || (b.line == a.line && b.col < a.col)) std::swap(a, b);
-        for (int line_idx = a.line; line_idx <= b.line && line_idx < (int)plain.size(); ++line_idx) {
-            int maxc = trimmed[line_idx];
-            if (maxc <= 0) continue;
-            int start_col = (line_idx == a.line) ? a.col : 0;
-            int end_col = (line_idx == b.line) ? b.col : maxc;
-            start_col = std::clamp(start_col, 0, maxc);
-            end_col = std::clamp(end_col, 0, maxc);
-            if (start_col == end_col) continue;
+        const ImU32 sel_color = ImGui::GetColorU32(ImVec4(0.2f,0.4f,1.0f,0.35f));
+        float cell_w = grid_renderer.CellWidth();
+        // Only the visible part of the selection; all positions are cell arithmetic.
+        for (int line_idx = std::max(a.line, first); line_idx <= b.line && line_idx < last; ++line_idx) {
+            int maxc = trimmed_cells(line_at(line_idx).cells);
+            int start_col = std::min((line_idx == a.line) ? a.col : 0, maxc);
+            int end_col = std::min((line_idx == b.line) ? b.col : maxc, maxc);
+            if (start_col >= end_col) continue;
             float y = origin.y + line_idx * line_height;
-            float x_start = origin.x + ImGui::CalcTextSize(plain[line_idx].substr(0, start_col).c_str()).x;
-            float x_end = origin.x + ImGui::CalcTextSize(plain[line_idx].substr(0, end_col).c_str()).x;
-            ImGui::GetWindowDrawList()->AddRectFilled(ImVec2(x_start, y), ImVec2(x_end, y + line_height), ImGui::GetColorU32(ImVec4(0.2f,0.4f,1.0f,0.35f)));
+            dl->AddRectFilled(ImVec2(origin.x + start_col * cell_w, y), ImVec2(origin.x + end_col * cell_w, y + line_height), sel_color);
         }
     }
 
-    // Auto-scroll
-    if (ImGui::GetScrollY() >= ImGui::GetScrollMaxY() - line_height * 2) {
+    // Auto-scroll, unless a search result was just brought into view
+    if (!jumped && ImGui::GetScrollY() >= ImGui::GetScrollMaxY() - line_height * 2) {
         ImGui::SetScrollHereY(1.0f);
     }
 
     // Copy shortcut (Ctrl)
     if (has_selection() && ImGui::GetIO().KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_C)) {
-        copy_selection_to_clipboard(origin, line_height, plain);
+        copy_selection_to_clipboard();
     }
 
     if (ImGui::BeginPopupContextWindow()) {
         if (has_selection()) {
             if (ImGui::MenuItem("Copy")) {
-                copy_selection_to_clipboard(origin, line_height, plain);
+                copy_selection_to_clipboard();
             }
         }
         if (ImGui::MenuItem("Paste")) {
             paste_clipboard();
         }
+        size_t last;
+        if (command_index.LastWithOutput(last) && ImGui::MenuItem("Copy Last Command Output")) {
+            copy_command_output(last);
+        }
         ImGui::EndPopup();
     }
 
     // Draw blinking cursor only when focused
-    if (focused) {
+    if (focused && view.cursor_visible) {
         float t = ImGui::GetTime();
         bool blink_on = fmodf(t, 1.0f) < 0.5f;
         if (blink_on) {
-            int line = (int)scrollback.size() + cursor_pos.row;
-            if (line >= 0 && line < (int)lines.size()) {
+            int line = (int)scrollback.Size() + view.cursor.row;
+            int col = echo.Showing() ? echo.CursorCol() : view.cursor.col;
+            if (line >= 0 && line < line_count) {
                 float y = origin.y + line * line_height;
-                std::string prefix = plain[line].substr(0, cursor_pos.col);
-                float x = origin.x + ImGui::CalcTextSize(prefix.c_str()).x;
+                float x = origin.x + col * grid_renderer.CellWidth();
                 ImVec2 p1(x, y);
                 ImVec2 p2(x + 2.0f, y + line_height - 2.0f);
                 ImGui::GetWindowDrawList()->AddRectFilled(p1, p2, ImGui::GetColorU32(ImVec4(0.9f,0.9f,0.9f,1.0f)));
@@ -423,14 +1252,152 @@ void Terminal::Render() {
     ImGui::PopStyleColor();
 }
 
+void Terminal::render_flood_indicator() {
+    char label[64];
+    const Snapshot& view = shown();
+    snprintf(label, sizeof(label), "%.1f MB/s  (%.0f MB)", view.throughput / (1 << 20), view.flood_bytes / double(1 << 20));
+    ImRect inner = ImGui::GetCurrentWindow()->InnerRect;
+    ImVec2 size = ImGui::CalcTextSize(label);
+    ImVec2 pad = ImGui::GetStyle().FramePadding;
+    ImVec2 max(inner.Max.x - pad.x, inner.Min.y + pad.y * 2 + size.y);
+    ImVec2 min(max.x - size.x - pad.x * 2, inner.Min.y);
+    ImDrawList* dl = ImGui::GetWindowDrawList();
+    dl->AddRectFilled(min, max, ImGui::GetColorU32(ImVec4(0.6f, 0.35f, 0.0f, 0.85f)), 3.0f);
+    dl->AddText(ImVec2(min.x + pad.x, min.y + pad.y), ImGui::GetColorU32(ImGuiCol_Text), label);
+}
+
+void Terminal::render_find_bar() {
+    if (find_focus) {
+        ImGui::SetKeyboardFocusHere();
+        find_focus = false;
+    }
+    ImGui::SetNextItemWidth(260.0f);
+    if (ImGui::InputTextWithHint("##find", "Find (Enter: older, Shift+Enter: newer)", find_buf, sizeof(find_buf),
+                                 ImGuiInputTextFlags_EnterReturnsTrue)) {
+        jump_to_match(!ImGui::GetIO().KeyShift);
+        find_focus = true;
+    }
+    bool close = ImGui::IsItemDeactivated() && ImGui::IsKeyPressed(ImGuiKey_Escape);
+    ImGui::SameLine();
+    ImGui::Checkbox("Regex", &find_regex);
+    ImGui::SameLine();
+    if (ImGui::ArrowButton("##find_up", ImGuiDir_Up)) jump_to_match(true);
+    ImGui::SameLine();
+    if (ImGui::ArrowButton("##find_down", ImGuiDir_Down)) jump_to_match(false);
+    ImGui::SameLine();
+    if (find_error) {
+        ImGui::TextColored(ImVec4(1.0f, 0.5f, 0.5f, 1.0f), "Invalid regex");
+    } else if (search.Failed()) {
+        ImGui::TextColored(ImVec4(1.0f, 0.5f, 0.5f, 1.0f), "Regex too complex");
+    } else if (search.Active()) {
+        ImGui::TextDisabled("%zu/%zu%s", search.CurrentIndex(), search.Count(), search.Scanning() ? "+" : "");
+    }
+    ImGui::SameLine();
+    if (ImGui::SmallButton("Close") || close) {
+        find_open = false;
+        find_buf[0] = '\0';
+    }
+
+    if (find_query != find_buf || find_query_regex != find_regex) {
+        find_query = find_buf;
+        find_query_regex = find_regex;
+        find_error = !search.Begin(find_query, find_regex);
+    }
+}
+
+void Terminal::update_search() {
+    if (!search.Active()) return;
+    int sb_size = (int)scrollback.Size();
+    int screen_rows = (int)shown().lines.size();
+    screen_text.resize(screen_rows);
+    for (int r = 0; r < screen_rows; ++r) screen_text[r] = line_text(sb_size + r);
+    // Leave most of the frame for rendering; the rest of the scan continues next frame.
+    search.Step(scrollback, screen_text, shown().grid_version, 4.0);
+}
+
+void Terminal::jump_to_match(bool up) {
+    if (!search.Navigate(up)) return;
+    uint64_t base = scrollback.FirstIndex();
+    if (search.Current().line >= base) scroll_to_line = (int)(search.Current().line - base);
+}
+
+// With sb_mutex held, from inside the scroll region. Prompts are brought to the
+// top of the view, so the next step starts from there.
+void Terminal::jump_to_command(bool up) {
+    float line_height = grid_renderer.CellHeight();
+    if (line_height <= 0) return;
+    uint64_t base = scrollback.FirstIndex();
+    uint64_t top = base + (uint64_t)(ImGui::GetScrollY() / line_height + 0.5f);
+    size_t i;
+    if (!(up ? command_index.Before(top, i) : command_index.After(top, i))) return;
+    uint64_t line = command_index[i].prompt;
+    if (line < base) return;
+    scroll_to_line = (int)(line - base);
+    scroll_line_top = true;
+}
+
+// Copy entry `index`'s output, one line per logical line. A command still running
+// has output up to the cursor.
+void Terminal::copy_command_output(size_t index) {
+    uint64_t begin, end;
+    if (!command_index.Output(index, begin, end)) return;
+    const Snapshot& view = shown();
+    uint64_t base = scrollback.FirstIndex();
+    int sb_size = (int)scrollback.Size();
+    if (end == CommandIndex::kNoLine) end = base + sb_size + view.cursor.row + (view.cursor.col > 0 ? 1 : 0);
+    end = std::min<uint64_t>(end, base + total_lines());
+    begin = std::max(begin, base);
+    std::string clip;
+    for (uint64_t l = begin; l < end; ++l) {
+        int i = (int)(l - base);
+        bool continuation = i < sb_size && scrollback.Continuation(i);
+        if (l > begin && !continuation) clip.push_back('\n');
+        std::string_view text = line_text(i);
+        if (i >= sb_size) {
+            while (!text.empty() && text.back() == ' ') text.remove_suffix(1);
+        }
+        clip.append(text.data(), text.size());
+    }
+    ImGui::SetClipboardText(clip.c_str());
+}
+
+void Terminal::draw_search_highlights(ImDrawList* dl, const ImVec2& origin, int first, int last) {
+    if (!search.Active()) return;
+    uint64_t base = scrollback.FirstIndex();
+    search.Visible(base + first, base + last, visible_matches);
+    float cell_w = grid_renderer.CellWidth();
+    float line_height = grid_renderer.CellHeight();
+    const ImU32 match_col = ImGui::GetColorU32(ImVec4(1.0f, 0.85f, 0.2f, 0.35f));
+    const ImU32 current_col = ImGui::GetColorU32(ImVec4(1.0f, 0.5f, 0.1f, 0.6f));
+    for (const SearchMatch& m : visible_matches) {
+        int line_idx = (int)(m.line - base);
+        const Line& line = line_at(line_idx);
+        float y = origin.y + line_idx * line_height;
+        float x0 = origin.x + byte_to_col(line, m.start) * cell_w;
+        float x1 = origin.x + byte_to_col(line, m.end) * cell_w;
+        bool is_current = search.HasCurrent() && search.Current().line == m.line && search.Current().start == m.start;
+        dl->AddRectFilled(ImVec2(x0, y), ImVec2(x1, y + line_height), is_current ? current_col : match_col);
+    }
+}
+
+// Map a byte offset in a line's text to its cell column; wide glyphs span two cells.
+int Terminal::byte_to_col(const Line& line, uint32_t byte) {
+    uint32_t bytes = 0;
+    int ncells = (int)line.cells.size();
+    for (int col = 0; col < ncells; ++col) {
+        uint32_t cp = line.cells[col].codepoint;
+        if (cp == (uint32_t)-1) continue;
+        if (bytes >= byte) return col;
+        bytes += utf8_length(cp == 0 ? ' ' : cp);
+    }
+    return ncells;
+}
+
 void Terminal::paste_clipboard() {
     const char* clip = ImGui::GetClipboardText();
     if (!clip) return;
-    vterm_keyboard_start_paste(vt);
-    vterm_input_write(vt, clip, strlen(clip));
-    vterm_keyboard_end_paste(vt);
-}
-
-void Terminal::send_control_char(char c) {
-    vterm_input_write(vt, &c, 1);
+    echo.Barrier(echo_screen(), false, seconds_now());
+    Command cmd(Command::Kind::Paste);
+    cmd.text = clip;
+    queue(std::move(cmd));
 }
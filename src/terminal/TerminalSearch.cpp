@@ -0,0 +1,263 @@
+#include "TerminalSearch.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+constexpr size_t kMinChunkLines = 1024;
+constexpr size_t kMaxChunkLines = 1u << 20;
+// Below this many lines a job runs on the calling thread.
+constexpr uint64_t kParallelThreshold = 2048;
+
+bool match_less(const SearchMatch& a, const SearchMatch& b) {
+    return a.line < b.line || (a.line == b.line && a.start < b.start);
+}
+
+bool line_less(const SearchMatch& m, uint64_t line) {
+    return m.line < line;
+}
+
+} // namespace
+
+TerminalSearch::TerminalSearch() {}
+
+TerminalSearch::~TerminalSearch() {
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        stopping = true;
+    }
+    pool_cv.notify_all();
+    for (auto& t : workers) t.join();
+}
+
+bool TerminalSearch::Begin(const std::string& query, bool regex) {
+    Clear();
+    failed = false;
+    if (query.empty()) return true;
+    if (regex) {
+        // std::regex reports bad patterns by throwing; surface that as a plain failure.
+        try {
+            re = std::regex(query, std::regex::ECMAScript | std::regex::optimize);
+        } catch (const std::regex_error&) {
+            return false;
+        }
+    }
+    pattern = query;
+    use_regex = regex;
+    active = true;
+    Restart();
+
+    if (workers.empty()) {
+        unsigned hw = std::thread::hardware_concurrency();
+        int count = std::clamp((int)hw - 1, 0, 7);
+        job_out.resize(count + 1);
+        for (int i = 0; i < count; ++i) workers.emplace_back(&TerminalSearch::worker_loop, this, i + 1);
+    }
+    return true;
+}
+
+void TerminalSearch::Clear() {
+    active = false;
+    pattern.clear();
+    matches.clear();
+    screen_matches.clear();
+    has_current = false;
+    history_done = true;
+}
+
+void TerminalSearch::Restart() {
+    matches.clear();
+    screen_matches.clear();
+    screen_seen = ~0ull;
+    old_next = new_next = ~0ull;    // set from the scrollback on the next Step
+    history_done = !active;
+    chunk_lines = kMinChunkLines;
+}
+
+void TerminalSearch::Step(const Scrollback& sb, const std::vector<std::string_view>& screen,
+                          uint64_t screen_version, double budget_ms) {
+    if (!active) return;
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    auto elapsed_ms = [&]() { return std::chrono::duration<double, std::milli>(clock::now() - start).count(); };
+
+    uint64_t first = sb.FirstIndex();
+    uint64_t end = first + sb.Size();
+    if (new_next == ~0ull) old_next = new_next = end;
+
+    // Drop hits on evicted lines, and on lines popped back onto the screen by a resize.
+    while (!matches.empty() && matches.front().line < first) matches.pop_front();
+    while (!matches.empty() && matches.back().line >= end) matches.pop_back();
+    new_next = std::min(new_next, end);
+    old_next = std::clamp(old_next, first, new_next);
+
+    LineFn lines = [&sb, first](uint64_t line) { return sb.Text((size_t)(line - first)); };
+    std::vector<SearchMatch> found;
+
+    // Lines pushed since the search began, oldest first.
+    while (new_next < end && matches.size() < kMaxMatches && elapsed_ms() < budget_ms) {
+        uint64_t hi = std::min<uint64_t>(end, new_next + chunk_lines);
+        found.clear();
+        run(lines, new_next, hi, found);
+        matches.insert(matches.end(), found.begin(), found.end());
+        new_next = hi;
+    }
+
+    // History, newest chunk first so recent hits show up immediately.
+    while (old_next > first && matches.size() < kMaxMatches) {
+        double before = elapsed_ms();
+        if (before >= budget_ms) break;
+        uint64_t lo = old_next - std::min<uint64_t>(chunk_lines, old_next - first);
+        found.clear();
+        run(lines, lo, old_next, found);
+        matches.insert(matches.begin(), found.begin(), found.end());
+        old_next = lo;
+        if (elapsed_ms() - before < budget_ms / 4) chunk_lines = std::min(chunk_lines * 2, kMaxChunkLines);
+    }
+    history_done = (old_next <= first && new_next >= end) || matches.size() >= kMaxMatches;
+
+    // The live screen is small; rescan it whenever it changes.
+    if (screen_version != screen_seen || end != screen_first) {
+        screen_matches.clear();
+        for (size_t r = 0; r < screen.size(); ++r) find_in_line(end + r, screen[r], screen_matches);
+        screen_seen = screen_version;
+        screen_first = end;
+    }
+    if (failed) Clear();
+}
+
+void TerminalSearch::Visible(uint64_t first, uint64_t last, std::vector<SearchMatch>& out) const {
+    out.clear();
+    for (auto it = std::lower_bound(matches.begin(), matches.end(), first, line_less);
+         it != matches.end() && it->line < last; ++it)
+        out.push_back(*it);
+    for (auto it = std::lower_bound(screen_matches.begin(), screen_matches.end(), first, line_less);
+         it != screen_matches.end() && it->line < last; ++it)
+        out.push_back(*it);
+}
+
+const SearchMatch& TerminalSearch::at(size_t index) const {
+    return index < matches.size() ? matches[index] : screen_matches[index - matches.size()];
+}
+
+// Index of the first match not ordered before `m`.
+size_t TerminalSearch::lower_bound_index(const SearchMatch& m) const {
+    size_t lo = 0, hi = Count();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (match_less(at(mid), m)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+bool TerminalSearch::Navigate(bool up) {
+    size_t count = Count();
+    if (count == 0) return false;
+    size_t pos = has_current ? lower_bound_index(current) : count;
+    size_t next;
+    if (up) {
+        next = pos == 0 ? count - 1 : pos - 1;
+    } else {
+        if (has_current && pos < count && !match_less(current, at(pos))) pos++;
+        next = pos >= count ? 0 : pos;
+    }
+    current = at(next);
+    has_current = true;
+    return true;
+}
+
+size_t TerminalSearch::CurrentIndex() const {
+    if (!has_current) return 0;
+    size_t pos = lower_bound_index(current);
+    if (pos < Count() && at(pos).line == current.line && at(pos).start == current.start) return pos + 1;
+    return 0;
+}
+
+void TerminalSearch::find_in_line(uint64_t line, std::string_view text, std::vector<SearchMatch>& out) const {
+    if (use_regex) {
+        if (failed.load(std::memory_order_relaxed)) return;
+        // Matching can throw too (error_complexity, error_stack); on a worker
+        // thread that would terminate the app.
+        try {
+            for (std::cregex_iterator it(text.data(), text.data() + text.size(), re), end; it != end; ++it) {
+                if (it->length(0) == 0) continue;
+                uint32_t pos = (uint32_t)it->position(0);
+                out.push_back(SearchMatch{line, pos, pos + (uint32_t)it->length(0)});
+            }
+        } catch (const std::regex_error&) {
+            failed = true;
+        }
+        return;
+    }
+    // memchr for the first byte, then compare the rest; both are vectorized in libc.
+    const size_t n = pattern.size();
+    const char* base = text.data();
+    const char* p = base;
+    const char* stop = base + text.size();
+    while ((size_t)(stop - p) >= n) {
+        p = static_cast<const char*>(memchr(p, pattern[0], (size_t)(stop - p) - n + 1));
+        if (!p) break;
+        if (memcmp(p + 1, pattern.data() + 1, n - 1) == 0) {
+            uint32_t pos = (uint32_t)(p - base);
+            out.push_back(SearchMatch{line, pos, pos + (uint32_t)n});
+            p += n;
+        } else {
+            ++p;
+        }
+    }
+}
+
+void TerminalSearch::run(const LineFn& lines, uint64_t lo, uint64_t hi, std::vector<SearchMatch>& out) {
+    if (workers.empty() || hi - lo < kParallelThreshold) {
+        for (uint64_t l = lo; l < hi; ++l) find_in_line(l, lines(l), out);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        job_lines = &lines;
+        job_lo = lo;
+        job_hi = hi;
+        job_pending = (int)workers.size();
+        job_id++;
+    }
+    pool_cv.notify_all();
+    scan_slice(0);
+    {
+        std::unique_lock<std::mutex> lock(pool_mutex);
+        done_cv.wait(lock, [this] { return job_pending == 0; });
+        job_lines = nullptr;
+    }
+    for (auto& part : job_out) {
+        out.insert(out.end(), part.begin(), part.end());
+        part.clear();
+    }
+}
+
+void TerminalSearch::scan_slice(int index) {
+    uint64_t slices = job_out.size();
+    uint64_t span = job_hi - job_lo;
+    uint64_t lo = job_lo + span * index / slices;
+    uint64_t hi = job_lo + span * (index + 1) / slices;
+    auto& out = job_out[index];
+    for (uint64_t l = lo; l < hi; ++l) find_in_line(l, (*job_lines)(l), out);
+}
+
+void TerminalSearch::worker_loop(int index) {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(pool_mutex);
+            pool_cv.wait(lock, [&] { return stopping || job_id != seen; });
+            if (stopping) return;
+            seen = job_id;
+        }
+        scan_slice(index);
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            job_pending--;
+        }
+        done_cv.notify_one();
+    }
+}
@@ -0,0 +1,452 @@
+#include "TmuxControl.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// tmux -CC opens control mode with this DCS and closes it with ST after %exit.
+constexpr char kMarker[] = "\x1bP1000p";
+constexpr size_t kMarkerLen = sizeof(kMarker) - 1;
+constexpr char kST[] = "\x1b\\";
+constexpr size_t kSTLen = sizeof(kST) - 1;
+// History fetched for panes that existed before attaching.
+constexpr int kCaptureLines = 5000;
+// Keys per send-keys command, so a paste does not make one huge command line.
+constexpr size_t kKeysPerCommand = 256;
+
+bool starts_with(const std::string& s, const char* prefix) {
+    return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// "%12 ..." or "@3 ..." -> 12 / 3, with `rest` after the following space.
+bool parse_id(const char* p, char sigil, int& id, const char** rest = nullptr) {
+    if (*p != sigil) return false;
+    char* end;
+    long v = strtol(p + 1, &end, 10);
+    if (end == p + 1) return false;
+    id = (int)v;
+    if (rest) *rest = *end == ' ' ? end + 1 : end;
+    return true;
+}
+
+bool is_octal(char c) {
+    return c >= '0' && c <= '7';
+}
+
+struct LayoutPane {
+    int id;
+    int cols;
+    int rows;
+};
+
+// One node of a layout: "WxH,X,Y" then ",ID" for a pane, or a list of nodes
+// in {} (side by side) or [] (stacked).
+bool parse_layout_node(const char*& p, std::vector<LayoutPane>& out) {
+    char* end;
+    long w = strtol(p, &end, 10);
+    if (end == p || *end != 'x') return false;
+    p = end + 1;
+    long h = strtol(p, &end, 10);
+    if (end == p || *end != ',') return false;
+    p = end + 1;
+    strtol(p, &end, 10);
+    if (end == p || *end != ',') return false;
+    p = end + 1;
+    strtol(p, &end, 10);
+    if (end == p) return false;
+    p = end;
+    if (*p == ',') {
+        long id = strtol(p + 1, &end, 10);
+        if (end == p + 1) return false;
+        p = end;
+        out.push_back(LayoutPane{(int)id, (int)w, (int)h});
+        return true;
+    }
+    if (*p != '{' && *p != '[') return false;
+    char close = *p == '{' ? '}' : ']';
+    do {
+        p++;
+        if (!parse_layout_node(p, out)) return false;
+    } while (*p == ',');
+    if (*p != close) return false;
+    p++;
+    return true;
+}
+
+// "b25d,80x24,0,0,0": a checksum, then the root node.
+bool parse_layout(const std::string& layout, std::vector<LayoutPane>& out) {
+    size_t comma = layout.find(',');
+    if (comma == std::string::npos) return false;
+    const char* p = layout.c_str() + comma + 1;
+    return parse_layout_node(p, out) && *p == '\0';
+}
+
+} // namespace
+
+size_t TmuxControl::Route(Terminal& main, const char* data, size_t len) {
+    size_t used = 0;
+    while (used < len) {
+        Mode before = mode;
+        size_t n = mode == Mode::Normal ? route_normal(main, data + used, len - used)
+                                        : route_control(data + used, len - used);
+        used += n;
+        if (n == 0 && mode == before) break;
+    }
+    return used;
+}
+
+// Passes output through to `main` up to the control-mode marker. A marker split
+// across reads is held back until it is complete or turns out to be something else.
+size_t TmuxControl::route_normal(Terminal& main, const char* data, size_t len) {
+    size_t i = 0;
+    while (marker_match && i < len) {
+        if (marker_fed || data[i] != kMarker[marker_match]) {
+            // Ordinary output after all. If the terminal is full, the rest stays held
+            // and this read is retried from the same byte.
+            marker_fed += main.Feed(kMarker + marker_fed, marker_match - marker_fed);
+            if (marker_fed < marker_match) return i;
+            marker_match = marker_fed = 0;
+            break;
+        }
+        i++;
+        if (++marker_match == kMarkerLen) {
+            marker_match = 0;
+            enter();
+            return i;
+        }
+    }
+    if (marker_match) return i;
+
+    size_t start = i;
+    while (i < len) {
+        const char* esc = static_cast<const char*>(memchr(data + i, 0x1b, len - i));
+        if (!esc) break;
+        size_t at = (size_t)(esc - data);
+        size_t n = std::min(kMarkerLen, len - at);
+        if (memcmp(esc, kMarker, n) == 0) {
+            size_t fed = main.Feed(data + start, at - start);
+            if (fed < at - start) return start + fed;
+            if (n < kMarkerLen) {
+                marker_match = n;
+                return len;
+            }
+            enter();
+            return at + kMarkerLen;
+        }
+        i = at + 1;
+    }
+    return start + main.Feed(data + start, len - start);
+}
+
+// Splits control-mode output into lines. Stops after a line whose pane output
+// did not all fit, so the channel backs up instead of this buffering it.
+size_t TmuxControl::route_control(const char* data, size_t len) {
+    if (mode == Mode::Control && !drain()) return 0;
+    size_t i = 0;
+    while (i < len) {
+        if (mode == Mode::Exiting) {
+            while (i < len && marker_match < kSTLen && data[i] == kST[marker_match]) {
+                i++;
+                marker_match++;
+            }
+            if (i == len && marker_match < kSTLen && marker_match > 0) return i;
+            Reset();
+            return i;
+        }
+        const char* nl = static_cast<const char*>(memchr(data + i, '\n', len - i));
+        if (!nl) {
+            line.append(data + i, len - i);
+            return len;
+        }
+        size_t end = (size_t)(nl - data);
+        line.append(data + i, end - i);
+        i = end + 1;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        handle_line(line);
+        line.clear();
+        if (!drain()) break;
+    }
+    return i;
+}
+
+void TmuxControl::enter() {
+    Reset();
+    mode = Mode::Control;
+    resync();
+}
+
+void TmuxControl::Reset() {
+    mode = Mode::Normal;
+    marker_match = 0;
+    marker_fed = 0;
+    line.clear();
+    in_reply = false;
+    reply_lines.clear();
+    sent.clear();
+    commands.clear();           // not sent yet; after control mode they would be typed at the shell
+    windows.clear();
+    panes.clear();
+    client_cols = client_rows = 0;
+}
+
+// Ask for the windows and panes of the attached session. The panes found are
+// filled from capture-pane; output for them is dropped until then, as the
+// capture already shows it.
+void TmuxControl::resync() {
+    windows.clear();
+    panes.clear();
+    send("list-windows -F \"#{window_id} #{window_layout} #{window_name}\"", Query::ListWindows);
+    send("list-panes -s -F \"#{pane_id} #{cursor_x} #{cursor_y}\"", Query::ListPanes);
+}
+
+void TmuxControl::send(const std::string& command, Query query, int pane) {
+    commands += command;
+    commands += '\n';
+    sent.push_back(Pending{query, pane});
+}
+
+std::string TmuxControl::TakeCommands() {
+    std::string out;
+    out.swap(commands);
+    return out;
+}
+
+void TmuxControl::feed(Pane& p) {
+    if (p.backlog.empty()) return;
+    size_t n = p.term->Feed(p.backlog);
+    p.backlog.erase(0, n);
+}
+
+bool TmuxControl::drain() {
+    bool clear = true;
+    for (Pane& p : panes) {
+        feed(p);
+        clear = clear && p.backlog.empty();
+    }
+    return clear;
+}
+
+void TmuxControl::handle_line(const std::string& l) {
+    if (in_reply) {
+        if ((starts_with(l, "%end ") && l.compare(5, std::string::npos, reply_guard) == 0) ||
+            (starts_with(l, "%error ") && l.compare(7, std::string::npos, reply_guard) == 0)) {
+            in_reply = false;
+            if (reply_ours) handle_reply(l[1] == 'e' && l[2] == 'n');
+            reply_lines.clear();
+        } else if (reply_ours && reply.query != Query::None) {
+            reply_lines.push_back(l);
+        }
+        return;
+    }
+
+    const char* rest;
+    int id;
+    if (starts_with(l, "%output ")) {
+        if (parse_id(l.c_str() + 8, '%', id, &rest)) handle_output(id, rest, l.size() - (size_t)(rest - l.c_str()));
+    } else if (starts_with(l, "%extended-output ")) {
+        // "%extended-output %ID AGE ... : DATA"
+        size_t colon = l.find(" : ");
+        if (colon != std::string::npos && parse_id(l.c_str() + 17, '%', id))
+            handle_output(id, l.c_str() + colon + 3, l.size() - colon - 3);
+    } else if (starts_with(l, "%begin ")) {
+        // "%begin TIME NUMBER FLAGS"; flag 1 marks a reply to this client's command.
+        in_reply = true;
+        reply_guard = l.substr(7);
+        size_t space = reply_guard.rfind(' ');
+        int flags = space == std::string::npos ? 0 : atoi(reply_guard.c_str() + space + 1);
+        reply_ours = (flags & 1) && !sent.empty();
+        if (reply_ours) {
+            reply = sent.front();
+            sent.erase(sent.begin());
+        }
+    } else if (starts_with(l, "%layout-change ")) {
+        // "%layout-change @W LAYOUT VISIBLE-LAYOUT FLAGS"
+        if (parse_id(l.c_str() + 15, '@', id, &rest)) {
+            const char* end = strchr(rest, ' ');
+            apply_layout(id, end ? std::string(rest, end) : std::string(rest), false);
+        }
+    } else if (starts_with(l, "%window-add ")) {
+        // A window made at the client size gets no %layout-change, so ask for its
+        // layout and fill its panes as when attaching.
+        if (parse_id(l.c_str() + 12, '@', id)) {
+            window(id);
+            std::string target = " -t @" + std::to_string(id);
+            send("list-windows" + target + " -F \"#{window_id} #{window_layout} #{window_name}\"", Query::ListWindows);
+            send("list-panes" + target + " -F \"#{pane_id} #{cursor_x} #{cursor_y}\"", Query::ListPanes);
+        }
+    } else if (starts_with(l, "%window-renamed ")) {
+        if (parse_id(l.c_str() + 16, '@', id, &rest)) window(id).name = rest;
+    } else if (starts_with(l, "%window-close ") || starts_with(l, "%unlinked-window-close ")) {
+        const char* at = strchr(l.c_str(), '@');
+        if (at && parse_id(at, '@', id)) {
+            panes.erase(std::remove_if(panes.begin(), panes.end(), [&](const Pane& p) { return p.window == id; }),
+                        panes.end());
+            windows.erase(std::remove_if(windows.begin(), windows.end(), [&](const Window& w) { return w.id == id; }),
+                          windows.end());
+        }
+    } else if (starts_with(l, "%session-changed ")) {
+        // Attaching reports the session too; only a switch needs everything again.
+        if (!windows.empty()) resync();
+    } else if (l == "%exit" || starts_with(l, "%exit ")) {
+        mode = Mode::Exiting;
+        marker_match = 0;
+    }
+}
+
+void TmuxControl::handle_reply(bool ok) {
+    Pending r = reply;
+    reply = Pending{Query::None, -1};
+    if (r.query == Query::Capture) {
+        Pane* p = FindPane(r.pane);
+        // A pane recreated by a resync gets two captures; the first one filled it.
+        if (!p || !p->syncing) return;
+        p->syncing = false;
+        if (!ok) return;
+        for (size_t i = 0; i < reply_lines.size(); ++i) {
+            if (i) p->backlog += "\x1b[m\r\n";
+            p->backlog += reply_lines[i];
+        }
+        char cup[32];
+        snprintf(cup, sizeof(cup), "\x1b[m\x1b[%d;%dH", p->cursor_y + 1, p->cursor_x + 1);
+        p->backlog += cup;
+        feed(*p);
+        return;
+    }
+    if (!ok) return;
+    for (const std::string& l : reply_lines) {
+        const char* rest;
+        int id;
+        if (r.query == Query::ListWindows && parse_id(l.c_str(), '@', id, &rest)) {
+            // "@W LAYOUT NAME"
+            const char* end = strchr(rest, ' ');
+            std::string layout = end ? std::string(rest, end) : std::string(rest);
+            window(id).name = end ? end + 1 : "";
+            apply_layout(id, layout, true);
+        } else if (r.query == Query::ListPanes && parse_id(l.c_str(), '%', id, &rest)) {
+            // "%P X Y"
+            Pane* p = FindPane(id);
+            if (p) sscanf(rest, "%d %d", &p->cursor_x, &p->cursor_y);
+        }
+    }
+}
+
+// %output escapes bytes below space, and backslash, as \ooo.
+void TmuxControl::handle_output(int pane, const char* data, size_t len) {
+    Pane* p = FindPane(pane);
+    if (!p || p->syncing) return;
+    std::string& out = p->backlog;
+    out.reserve(out.size() + len);
+    for (size_t i = 0; i < len; ++i) {
+        if (data[i] == '\\' && i + 3 < len && is_octal(data[i + 1]) && is_octal(data[i + 2]) && is_octal(data[i + 3])) {
+            out += (char)(((data[i + 1] - '0') << 6) | ((data[i + 2] - '0') << 3) | (data[i + 3] - '0'));
+            i += 3;
+        } else {
+            out += data[i];
+        }
+    }
+    feed(*p);
+}
+
+// Sizes each pane of a window from its layout; panes that left the window are
+// closed unless the layout of another window already took them over.
+void TmuxControl::apply_layout(int window_id, const std::string& layout, bool attaching) {
+    std::vector<LayoutPane> leaves;
+    if (!parse_layout(layout, leaves)) return;
+    Window& w = window(window_id);
+    std::vector<int> old = std::move(w.panes);
+    w.panes.clear();
+    for (const LayoutPane& leaf : leaves) {
+        w.panes.push_back(leaf.id);
+        if (Pane* p = FindPane(leaf.id)) {
+            p->window = window_id;
+            p->term->SetFixedSize(leaf.cols, leaf.rows);
+            continue;
+        }
+        Pane& p = add_pane(leaf.id, window_id, leaf.cols, leaf.rows);
+        if (attaching) {
+            p.syncing = true;
+            char cmd[96];
+            snprintf(cmd, sizeof(cmd), "capture-pane -p -e -J -q -t %%%d -S -%d", leaf.id, kCaptureLines);
+            send(cmd, Query::Capture, leaf.id);
+        }
+    }
+    for (int id : old) {
+        const Pane* p = FindPane(id);
+        if (p && p->window == window_id && std::find(w.panes.begin(), w.panes.end(), id) == w.panes.end())
+            remove_pane(id);
+    }
+}
+
+TmuxControl::Window& TmuxControl::window(int id) {
+    for (Window& w : windows) {
+        if (w.id == id) return w;
+    }
+    windows.push_back(Window());
+    windows.back().id = id;
+    return windows.back();
+}
+
+TmuxControl::Pane* TmuxControl::FindPane(int id) {
+    for (Pane& p : panes) {
+        if (p.id == id) return &p;
+    }
+    return nullptr;
+}
+
+TmuxControl::Pane& TmuxControl::add_pane(int id, int window_id, int cols, int rows) {
+    Pane p;
+    p.id = id;
+    p.window = window_id;
+    p.term = std::make_unique<Terminal>(cols, rows);
+    p.term->SetFixedSize(cols, rows);
+    if (notify_callback) p.term->SetNotifyCallback(notify_callback);
+    if (!highlight_rules.empty()) p.term->SetHighlightRules(highlight_rules);
+    panes.push_back(std::move(p));
+    return panes.back();
+}
+
+void TmuxControl::remove_pane(int id) {
+    panes.erase(std::remove_if(panes.begin(), panes.end(), [&](const Pane& p) { return p.id == id; }), panes.end());
+}
+
+void TmuxControl::Pump() {
+    drain();
+    for (Pane& p : panes) {
+        std::string keys = p.term->ConsumeOutgoing();
+        for (size_t at = 0; at < keys.size(); at += kKeysPerCommand) {
+            std::string cmd = "send-keys -H -t %" + std::to_string(p.id);
+            char hex[4];
+            for (size_t i = at; i < std::min(keys.size(), at + kKeysPerCommand); ++i) {
+                snprintf(hex, sizeof(hex), " %02x", (unsigned char)keys[i]);
+                cmd += hex;
+            }
+            send(cmd);
+        }
+    }
+}
+
+void TmuxControl::SetClientSize(int cols, int rows) {
+    if (!Active() || (cols == client_cols && rows == client_rows)) return;
+    client_cols = cols;
+    client_rows = rows;
+    send("refresh-client -C " + std::to_string(cols) + "," + std::to_string(rows));
+}
+
+bool TmuxControl::WantsFrame() const {
+    for (const Pane& p : panes) {
+        if (!p.backlog.empty() || p.term->WantsFrame()) return true;
+    }
+    return false;
+}
+
+void TmuxControl::SetNotifyCallback(std::function<void()> cb) {
+    notify_callback = std::move(cb);
+    for (Pane& p : panes) p.term->SetNotifyCallback(notify_callback);
+}
+
+void TmuxControl::SetHighlightRules(const std::vector<HighlightRule>& rules) {
+    highlight_rules = rules;
+    for (Pane& p : panes) p.term->SetHighlightRules(highlight_rules);
+}
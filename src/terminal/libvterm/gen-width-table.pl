@@ -0,0 +1,88 @@
+#!/usr/bin/perl
+
+# Generates src/widthtable.inc, the two-level lookup table behind
+# vterm_unicode_width() and vterm_unicode_is_combining(), from the
+# 'combining' table in src/unicode.c and from src/fullwidth.inc.
+#
+#   perl gen-width-table.pl > src/widthtable.inc
+
+use strict;
+use warnings;
+
+use File::Basename qw( dirname );
+
+my $dir = dirname( $0 ) . "/src";
+
+sub read_intervals
+{
+   my ( $text ) = @_;
+   my @ranges;
+   while( $text =~ m/\{\s*(0x[0-9A-Fa-f]+)\s*,\s*(0x[0-9A-Fa-f]+)\s*\}/g ) {
+      push @ranges, [ hex $1, hex $2 ];
+   }
+   return @ranges;
+}
+
+sub slurp
+{
+   my ( $path ) = @_;
+   open my $fh, "<", $path or die "Cannot open $path - $!\n";
+   local $/;
+   return <$fh>;
+}
+
+my ( $combining_src ) = slurp( "$dir/unicode.c" ) =~ m/combining\[\] = \{(.*?)\};/s
+   or die "Cannot find the combining table in unicode.c\n";
+
+my @combining = read_intervals( $combining_src );
+my @fullwidth = read_intervals( slurp( "$dir/fullwidth.inc" ) );
+
+use constant MAX_CP => 0x10FFFF;
+use constant BLOCK  => 256;
+
+# Per codepoint: bits 0-1 hold the width (3 meaning -1), bit 2 marks combining
+my @cell = (1) x ( MAX_CP + 1 );
+
+# mk_wcwidth()'s East Asian ranges
+my @wide = (
+   [ 0x1100, 0x115f ], [ 0x2329, 0x232a ], [ 0x2e80, 0x303e ], [ 0x3040, 0xa4cf ],
+   [ 0xac00, 0xd7a3 ], [ 0xf900, 0xfaff ], [ 0xfe10, 0xfe19 ], [ 0xfe30, 0xfe6f ],
+   [ 0xff00, 0xff60 ], [ 0xffe0, 0xffe6 ], [ 0x20000, 0x2fffd ], [ 0x30000, 0x3fffd ],
+);
+
+$cell[$_] = 2 for map { $_->[0] .. $_->[1] } @wide;
+$cell[$_] = 0 for map { $_->[0] .. $_->[1] } @combining;
+$cell[$_] = 3 for 0x01 .. 0x1f, 0x7f .. 0x9f;
+$cell[0] = 0;
+$cell[$_] = 2 for map { $_->[0] .. $_->[1] } @fullwidth;
+$cell[$_] |= 4 for map { $_->[0] .. $_->[1] } @combining;
+
+my ( @index, @blocks, %seen );
+for( my $base = 0; $base <= MAX_CP; $base += BLOCK ) {
+   my $key = join ",", @cell[$base .. $base + BLOCK - 1];
+   $seen{$key} //= do { push @blocks, $key; $#blocks };
+   push @index, $seen{$key};
+}
+
+die "Too many distinct blocks for a uint8_t index\n" if @blocks > 256;
+
+print "/* Generated by gen-width-table.pl from unicode.c and fullwidth.inc; do not edit */\n\n";
+printf "#define WIDTH_TABLE_SHIFT %d\n\n", log( BLOCK ) / log( 2 );
+
+print "static const uint8_t width_index[] = {\n";
+for( my $i = 0; $i < @index; $i += 16 ) {
+   my $end = $i + 15 < $#index ? $i + 15 : $#index;
+   print "  ", join( ",", @index[$i .. $end] ), ",\n";
+}
+print "};\n\n";
+
+printf "static const uint8_t width_blocks[][%d] = {\n", BLOCK;
+foreach my $key ( @blocks ) {
+   my @v = split m/,/, $key;
+   print "  {\n";
+   for( my $i = 0; $i < @v; $i += 32 ) {
+      print "    ", join( ",", @v[$i .. $i + 31] ), ",\n";
+   }
+   print "  },\n";
+}
+print "};\n";
@@ -266,6 +266,7 @@ typedef enum {
   VTERM_PROP_CURSORSHAPE,       // number
   VTERM_PROP_MOUSE,             // number
   VTERM_PROP_FOCUSREPORT,       // bool
+  VTERM_PROP_SYNCHRONIZED,      // bool
 
   VTERM_N_PROPS
 } VTermProp;
@@ -303,6 +304,16 @@ typedef struct {
   unsigned int    dhl:2;             /* DECDHL double-height line (1=top 2=bottom) */
 } VTermGlyphInfo;
 
+/* A run of single-width glyphs with no combining characters, one codepoint
+ * per cell, placed left to right from the given position on one line */
+typedef struct {
+  const uint32_t *chars;
+  int             count;
+  unsigned int    protected_cell:1;  /* DECSCA-protected against DECSEL/DECSED */
+  unsigned int    dwl:1;             /* DECDWL or DECDHL double-width line */
+  unsigned int    dhl:2;             /* DECDHL double-height line (1=top 2=bottom) */
+} VTermGlyphRun;
+
 typedef struct {
   unsigned int    doublewidth:1;     /* DECDWL or DECDHL line */
   unsigned int    doubleheight:2;    /* DECDHL line (1=top 2=bottom) */
@@ -445,6 +456,9 @@ typedef struct {
   int (*sb_clear)(void *user);
   // ABI-compat only enabled if vterm_state_callbacks_has_premove() is invoked
   int (*premove)(VTermRect dest, void *user);
+  // ABI-compat only enabled if vterm_state_callbacks_has_putglyphs() is invoked.
+  // Returning 0 makes the state fall back to putglyph for each glyph of the run
+  int (*putglyphs)(VTermGlyphRun *run, VTermPos pos, void *user);
 } VTermStateCallbacks;
 
 typedef struct {
@@ -468,6 +482,7 @@ void  vterm_state_set_callbacks(VTermState *state, const VTermStateCallbacks *ca
 void *vterm_state_get_cbdata(VTermState *state);
 
 void vterm_state_callbacks_has_premove(VTermState *state);
+void vterm_state_callbacks_has_putglyphs(VTermState *state);
 
 void  vterm_state_set_unrecognised_fallbacks(VTermState *state, const VTermStateFallbacks *fallbacks, void *user);
 void *vterm_state_get_unrecognised_fbdata(VTermState *state);
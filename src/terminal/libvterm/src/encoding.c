@@ -25,11 +25,80 @@ static void init_utf8(VTermEncoding *enc, void *data_)
   data->bytes_total     = 0;
 }
 
+/* Applies the overlong and invalid-codepoint checks to a finished sequence */
+static uint32_t check_utf8(uint32_t cp, int bytes_total)
+{
+  static const uint32_t min_cp[7] = { 0, 0, 0x80, 0x800, 0x10000, 0x200000, 0x4000000 };
+
+  if(cp < min_cp[bytes_total])
+    return UNICODE_INVALID;
+  if((cp >= 0xD800 && cp <= 0xDFFF) || cp == 0xFFFE || cp == 0xFFFF)
+    return UNICODE_INVALID;
+  return cp;
+}
+
+/* Copies the run of printable ASCII at the start of bytes[] into cp[], up to
+ * len bytes, and returns its length */
+static size_t decode_ascii_run(uint32_t cp[], const unsigned char *bytes, size_t len)
+{
+  size_t n = 0;
+
+#if defined(VTERM_SIMD_SSE2)
+  /* Signed compares: 0x20..0x7e are exactly the bytes greater than 0x1f that
+   * are not 0x7f, since 0x80 and up read as negative */
+  const __m128i c0   = _mm_set1_epi8(0x1f);
+  const __m128i del  = _mm_set1_epi8(0x7f);
+  const __m128i zero = _mm_setzero_si128();
+
+  for( ; n + 16 <= len; n += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(bytes + n));
+    __m128i ok = _mm_andnot_si128(_mm_cmpeq_epi8(v, del), _mm_cmpgt_epi8(v, c0));
+    if(_mm_movemask_epi8(ok) != 0xffff)
+      break;
+
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+    _mm_storeu_si128((__m128i *)(cp + n),      _mm_unpacklo_epi16(lo, zero));
+    _mm_storeu_si128((__m128i *)(cp + n + 4),  _mm_unpackhi_epi16(lo, zero));
+    _mm_storeu_si128((__m128i *)(cp + n + 8),  _mm_unpacklo_epi16(hi, zero));
+    _mm_storeu_si128((__m128i *)(cp + n + 12), _mm_unpackhi_epi16(hi, zero));
+  }
+#elif defined(VTERM_SIMD_NEON)
+  const uint8x16_t c0  = vdupq_n_u8(0x1f);
+  const uint8x16_t del = vdupq_n_u8(0x7f);
+
+  for( ; n + 16 <= len; n += 16) {
+    uint8x16_t v = vld1q_u8(bytes + n);
+    // 0x7f and up, or 0x1f and below
+    uint8x16_t bad = vorrq_u8(vcgeq_u8(v, del), vcleq_u8(v, c0));
+    if(vmaxvq_u8(bad))
+      break;
+
+    uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+    uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+    vst1q_u32(cp + n,      vmovl_u16(vget_low_u16(lo)));
+    vst1q_u32(cp + n + 4,  vmovl_u16(vget_high_u16(lo)));
+    vst1q_u32(cp + n + 8,  vmovl_u16(vget_low_u16(hi)));
+    vst1q_u32(cp + n + 12, vmovl_u16(vget_high_u16(hi)));
+  }
+#endif
+
+  for( ; n < len; n++) {
+    unsigned char c = bytes[n];
+    if(c < 0x20 || c >= 0x7f)
+      break;
+    cp[n] = c;
+  }
+
+  return n;
+}
+
 static void decode_utf8(VTermEncoding *enc, void *data_,
                         uint32_t cp[], int *cpi, int cplen,
                         const char bytes[], size_t *pos, size_t bytelen)
 {
   struct UTF8DecoderData *data = data_;
+  const unsigned char *ubytes = (const unsigned char *)bytes;
 
 #ifdef DEBUG_PRINT_UTF8
   printf("BEGIN UTF-8\n");
@@ -42,6 +111,40 @@ static void decode_utf8(VTermEncoding *enc, void *data_,
     printf(" pos=%zd c=%02x rem=%d\n", *pos, c, data->bytes_remaining);
 #endif
 
+    /* Fast paths between sequences: runs of ASCII, and 2- to 4-byte sequences
+     * that are complete in this buffer. Anything else, including sequences
+     * split across writes and malformed input, goes through the state machine.
+     */
+    if(!data->bytes_remaining && c >= 0x20) {
+      if(c < 0x7f) {
+        size_t n = decode_ascii_run(cp + *cpi, ubytes + *pos,
+            bytelen - *pos < (size_t)(cplen - *cpi) ? bytelen - *pos : (size_t)(cplen - *cpi));
+        *cpi += n;
+        *pos += n - 1;
+        continue;
+      }
+
+      int total = c >= 0xc0 && c < 0xe0 ? 2 :
+                  c >= 0xe0 && c < 0xf0 ? 3 :
+                  c >= 0xf0 && c < 0xf8 ? 4 : 0;
+      if(total && bytelen - *pos >= (size_t)total) {
+        const unsigned char *s = ubytes + *pos;
+        bool whole = (s[1] & 0xc0) == 0x80 &&
+                     (total < 3 || (s[2] & 0xc0) == 0x80) &&
+                     (total < 4 || (s[3] & 0xc0) == 0x80);
+        if(whole) {
+          uint32_t this_cp =
+            total == 2 ? (uint32_t)(c & 0x1f) << 6  | (s[1] & 0x3f) :
+            total == 3 ? (uint32_t)(c & 0x0f) << 12 | (uint32_t)(s[1] & 0x3f) << 6 | (s[2] & 0x3f) :
+                         (uint32_t)(c & 0x07) << 18 | (uint32_t)(s[1] & 0x3f) << 12 |
+                         (uint32_t)(s[2] & 0x3f) << 6 | (s[3] & 0x3f);
+          cp[(*cpi)++] = check_utf8(this_cp, total);
+          *pos += total - 1;
+          continue;
+        }
+      }
+    }
+
     if(c < 0x20) // C0
       return;
 
@@ -73,29 +176,7 @@ static void decode_utf8(VTermEncoding *enc, void *data_,
 #ifdef DEBUG_PRINT_UTF8
         printf(" UTF-8 raw char U+%04x bytelen=%d ", data->this_cp, data->bytes_total);
 #endif
-        // Check for overlong sequences
-        switch(data->bytes_total) {
-        case 2:
-          if(data->this_cp <  0x0080) data->this_cp = UNICODE_INVALID;
-          break;
-        case 3:
-          if(data->this_cp <  0x0800) data->this_cp = UNICODE_INVALID;
-          break;
-        case 4:
-          if(data->this_cp < 0x10000) data->this_cp = UNICODE_INVALID;
-          break;
-        case 5:
-          if(data->this_cp < 0x200000) data->this_cp = UNICODE_INVALID;
-          break;
-        case 6:
-          if(data->this_cp < 0x4000000) data->this_cp = UNICODE_INVALID;
-          break;
-        }
-        // Now look for plain invalid ones
-        if((data->this_cp >= 0xD800 && data->this_cp <= 0xDFFF) ||
-           data->this_cp == 0xFFFE ||
-           data->this_cp == 0xFFFF)
-          data->this_cp = UNICODE_INVALID;
+        data->this_cp = check_utf8(data->this_cp, data->bytes_total);
 #ifdef DEBUG_PRINT_UTF8
         printf(" char: U+%04x\n", data->this_cp);
 #endif
@@ -10,6 +10,67 @@ static bool is_intermed(unsigned char c)
   return c >= 0x20 && c <= 0x2f;
 }
 
+static bool is_printable(unsigned char c, bool c1_allowed)
+{
+  if(c < 0x20 || c == 0x7f)
+    return false;
+  return !(c1_allowed && c >= 0x80 && c < 0xa0);
+}
+
+/* Returns the length of the run of bytes at the start of bytes[] that contains
+ * no C0 controls, no DEL and, when C1 is allowed, no raw C1 controls. Shell
+ * output is mostly long runs of these, so they are found a stride at a time.
+ */
+static size_t scan_printable(const char *bytes, size_t len, bool c1_allowed)
+{
+  size_t pos = 0;
+
+#if defined(VTERM_SIMD_SSE2)
+  /* C0 and C1 only differ in the top bit, so masking it off lets one unsigned
+   * compare catch both: (c & mask) <= 0x1f. */
+  const __m128i top  = _mm_set1_epi8(c1_allowed ? 0x7f : (char)0xff);
+  const __m128i c0   = _mm_set1_epi8(0x1f);
+  const __m128i del  = _mm_set1_epi8(0x7f);
+
+  for( ; pos + 32 <= len; pos += 32) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(bytes + pos));
+    __m128i b = _mm_loadu_si128((const __m128i *)(bytes + pos + 16));
+    __m128i am = _mm_and_si128(a, top);
+    __m128i bm = _mm_and_si128(b, top);
+    __m128i ahit = _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(am, c0), c0), _mm_cmpeq_epi8(a, del));
+    __m128i bhit = _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(bm, c0), c0), _mm_cmpeq_epi8(b, del));
+    unsigned int mask = (unsigned int)_mm_movemask_epi8(ahit) |
+                        (unsigned int)_mm_movemask_epi8(bhit) << 16;
+    if(mask) {
+# if defined(__GNUC__)
+      return pos + __builtin_ctz(mask);
+# else
+      break;
+# endif
+    }
+  }
+#elif defined(VTERM_SIMD_NEON)
+  const uint8x16_t top = vdupq_n_u8(c1_allowed ? 0x7f : 0xff);
+  const uint8x16_t c0  = vdupq_n_u8(0x1f);
+  const uint8x16_t del = vdupq_n_u8(0x7f);
+
+  for( ; pos + 32 <= len; pos += 32) {
+    uint8x16_t a = vld1q_u8((const uint8_t *)bytes + pos);
+    uint8x16_t b = vld1q_u8((const uint8_t *)bytes + pos + 16);
+    uint8x16_t ahit = vorrq_u8(vcleq_u8(vandq_u8(a, top), c0), vceqq_u8(a, del));
+    uint8x16_t bhit = vorrq_u8(vcleq_u8(vandq_u8(b, top), c0), vceqq_u8(b, del));
+    if(vmaxvq_u8(vorrq_u8(ahit, bhit)))
+      break; // the scalar tail finds the exact position
+  }
+#endif
+
+  for( ; pos < len; pos++)
+    if(!is_printable(bytes[pos], c1_allowed))
+      break;
+
+  return pos;
+}
+
 static void do_control(VTerm *vt, unsigned char control)
 {
   if(vt->parser.callbacks && vt->parser.callbacks->control)
@@ -359,17 +420,25 @@ string_state:
         }
       }
       else {
-        size_t eaten = 0;
-        if(vt->parser.callbacks && vt->parser.callbacks->text)
-          eaten = (*vt->parser.callbacks->text)(bytes + pos, len - pos, vt->parser.cbdata);
-
-        if(!eaten) {
-          DEBUG_LOG("libvterm: Text callback did not consume any input\n");
-          /* force it to make progress */
-          eaten = 1;
+        /* Hand the whole printable run to the text callback, so neither it nor
+         * this loop has to look at those bytes one at a time */
+        size_t end = pos + 1 + scan_printable(bytes + pos + 1, len - pos - 1, c1_allowed);
+
+        while(pos < end) {
+          size_t eaten = end - pos;
+          if(vt->parser.callbacks && vt->parser.callbacks->text)
+            eaten = (*vt->parser.callbacks->text)(bytes + pos, end - pos, vt->parser.cbdata);
+
+          if(!eaten) {
+            DEBUG_LOG("libvterm: Text callback did not consume any input\n");
+            /* force it to make progress */
+            eaten = 1;
+          }
+
+          pos += eaten;
         }
 
-        pos += (eaten - 1); // we'll ++ it again in a moment
+        pos--; // we'll ++ it again in a moment
       }
       break;
     }
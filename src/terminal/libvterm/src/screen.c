@@ -41,6 +41,14 @@ typedef struct
   ScreenPen pen;
 } ScreenCell;
 
+/* A grid of cells reached through one pointer per row, so that scrolling
+ * whole rows only has to rotate the row pointers */
+typedef struct
+{
+  ScreenCell **lines;
+  ScreenCell *cells; /* rows * cols, in no particular row order */
+} ScreenBuffer;
+
 struct VTermScreen
 {
   VTerm *vt;
@@ -63,10 +71,10 @@ struct VTermScreen
   unsigned int reflow : 1;
 
   /* Primary and Altscreen. buffers[1] is lazily allocated as needed */
-  ScreenCell *buffers[2];
+  ScreenBuffer *buffers[2];
 
   /* buffer will == buffers[0] or buffers[1], depending on altscreen */
-  ScreenCell *buffer;
+  ScreenBuffer *buffer;
 
   /* buffer for a single screen row used in scrollback storage callbacks */
   VTermScreenCell *sb_buffer;
@@ -86,20 +94,50 @@ static inline ScreenCell *getcell(const VTermScreen *screen, int row, int col)
     return NULL;
   if(col < 0 || col >= screen->cols)
     return NULL;
-  return screen->buffer + (screen->cols * row) + col;
+  return screen->buffer->lines[row] + col;
 }
 
-static ScreenCell *alloc_buffer(VTermScreen *screen, int rows, int cols)
+/* One allocation holds the buffer, its row pointers and its cells. Rows start
+ * out in order, so cells[] can be filled as a plain rows * cols array */
+static ScreenBuffer *new_buffer(VTermScreen *screen, int rows, int cols)
 {
-  ScreenCell *new_buffer = vterm_allocator_malloc(screen->vt, sizeof(ScreenCell) * rows * cols);
+  ScreenBuffer *buffer = vterm_allocator_malloc(screen->vt,
+      sizeof(ScreenBuffer) + sizeof(ScreenCell *) * rows + sizeof(ScreenCell) * rows * cols);
 
-  for(int row = 0; row < rows; row++) {
-    for(int col = 0; col < cols; col++) {
-      clearcell(screen, &new_buffer[row * cols + col]);
-    }
+  buffer->lines = (ScreenCell **)(buffer + 1);
+  buffer->cells = (ScreenCell *)(buffer->lines + rows);
+
+  for(int row = 0; row < rows; row++)
+    buffer->lines[row] = buffer->cells + row * cols;
+
+  return buffer;
+}
+
+static ScreenBuffer *alloc_buffer(VTermScreen *screen, int rows, int cols)
+{
+  ScreenBuffer *buffer = new_buffer(screen, rows, cols);
+
+  for(int i = 0; i < rows * cols; i++)
+    clearcell(screen, &buffer->cells[i]);
+
+  return buffer;
+}
+
+static void reverse_lines(ScreenCell **lines, int start, int end)
+{
+  for(end--; start < end; start++, end--) {
+    ScreenCell *tmp = lines[start];
+    lines[start] = lines[end];
+    lines[end] = tmp;
   }
+}
 
-  return new_buffer;
+/* Rotates lines[start..end) so that lines[start + by] comes first */
+static void rotate_lines(ScreenCell **lines, int start, int end, int by)
+{
+  reverse_lines(lines, start, start + by);
+  reverse_lines(lines, start + by, end);
+  reverse_lines(lines, start, end);
 }
 
 static void damagerect(VTermScreen *screen, VTermRect rect)
@@ -206,6 +244,37 @@ static int putglyph(VTermGlyphInfo *info, VTermPos pos, void *user)
   return 1;
 }
 
+static int putglyphs(VTermGlyphRun *run, VTermPos pos, void *user)
+{
+  VTermScreen *screen = user;
+  ScreenCell *cell = getcell(screen, pos.row, pos.col);
+
+  if(!cell || pos.col + run->count > screen->cols)
+    return 0;
+
+  ScreenPen pen = screen->pen;
+  pen.protected_cell = run->protected_cell;
+  pen.dwl            = run->dwl;
+  pen.dhl            = run->dhl;
+
+  for(int i = 0; i < run->count; i++, cell++) {
+    cell->chars[0] = run->chars[i];
+    cell->chars[1] = 0;
+    cell->pen = pen;
+  }
+
+  VTermRect rect = {
+    .start_row = pos.row,
+    .end_row   = pos.row+1,
+    .start_col = pos.col,
+    .end_col   = pos.col+run->count,
+  };
+
+  damagerect(screen, rect);
+
+  return 1;
+}
+
 static void sb_pushline_from_row(VTermScreen *screen, int row, bool continuation)
 {
   VTermPos pos = { .row = row };
@@ -243,6 +312,18 @@ static int moverect_internal(VTermRect dest, VTermRect src, void *user)
   int cols = src.end_col - src.start_col;
   int downward = src.start_row - dest.start_row;
 
+  if(cols == screen->cols && downward) {
+    /* Full-width scroll: the rows that fall off one end are exactly the rows
+     * the caller erases at the other end, so reorder the pointers instead of
+     * copying cells */
+    if(downward > 0)
+      rotate_lines(screen->buffer->lines, dest.start_row, src.end_row, downward);
+    else
+      rotate_lines(screen->buffer->lines, src.start_row, dest.end_row,
+          dest.end_row - src.start_row + downward);
+    return 1;
+  }
+
   int init_row, test_row, inc_row;
   if(downward < 0) {
     init_row = dest.end_row - 1;
@@ -508,10 +589,10 @@ static int bell(void *user)
 
 /* How many cells are non-blank
  * Returns the position of the first blank cell in the trailing blank end */
-static int line_popcount(ScreenCell *buffer, int row, int rows, int cols)
+static int line_popcount(ScreenBuffer *buffer, int row, int rows, int cols)
 {
   int col = cols - 1;
-  while(col >= 0 && buffer[row * cols + col].chars[0] == 0)
+  while(col >= 0 && buffer->lines[row][col].chars[0] == 0)
     col--;
   return col + 1;
 }
@@ -521,10 +602,13 @@ static void resize_buffer(VTermScreen *screen, int bufidx, int new_rows, int new
   int old_rows = screen->rows;
   int old_cols = screen->cols;
 
-  ScreenCell *old_buffer = screen->buffers[bufidx];
+  ScreenBuffer *old_buffer = screen->buffers[bufidx];
   VTermLineInfo *old_lineinfo = statefields->lineinfos[bufidx];
 
-  ScreenCell *new_buffer = vterm_allocator_malloc(screen->vt, sizeof(ScreenCell) * new_rows * new_cols);
+  /* The new buffer's rows are in order until it is installed below, so it is
+   * filled through its cells[] array directly */
+  ScreenBuffer *new_screenbuffer = new_buffer(screen, new_rows, new_cols);
+  ScreenCell *new_buffer = new_screenbuffer->cells;
   VTermLineInfo *new_lineinfo = vterm_allocator_malloc(screen->vt, sizeof(new_lineinfo[0]) * new_rows);
 
   int old_row = old_rows - 1;
@@ -625,7 +709,7 @@ static void resize_buffer(VTermScreen *screen, int bufidx, int new_rows, int new
 
       while(count) {
         /* TODO: This could surely be done a lot faster by memcpy()'ing the entire range */
-        new_buffer[new_row * new_cols + new_col] = old_buffer[old_row * old_cols + old_col];
+        new_buffer[new_row * new_cols + new_col] = old_buffer->lines[old_row][old_col];
 
         if(old_cursor.row == old_row && old_cursor.col == old_col)
           new_cursor.row = new_row, new_cursor.col = new_col;
@@ -747,7 +831,7 @@ static void resize_buffer(VTermScreen *screen, int bufidx, int new_rows, int new
   }
 
   vterm_allocator_free(screen->vt, old_buffer);
-  screen->buffers[bufidx] = new_buffer;
+  screen->buffers[bufidx] = new_screenbuffer;
 
   vterm_allocator_free(screen->vt, old_lineinfo);
   statefields->lineinfos[bufidx] = new_lineinfo;
@@ -864,6 +948,7 @@ static VTermStateCallbacks state_cbs = {
   .resize      = &resize,
   .setlineinfo = &setlineinfo,
   .sb_clear    = &sb_clear,
+  .putglyphs   = &putglyphs,
 };
 
 static VTermScreen *screen_new(VTerm *vt)
@@ -902,6 +987,7 @@ static VTermScreen *screen_new(VTerm *vt)
 
   vterm_state_set_callbacks(screen->state, &state_cbs, screen);
   vterm_state_callbacks_has_premove(screen->state);
+  vterm_state_callbacks_has_putglyphs(screen->state);
 
   return screen;
 }
@@ -1180,16 +1266,15 @@ void vterm_screen_convert_color_to_rgb(const VTermScreen *screen, VTermColor *co
   vterm_state_convert_color_to_rgb(screen->state, col);
 }
 
-static void reset_default_colours(VTermScreen *screen, ScreenCell *buffer)
+static void reset_default_colours(VTermScreen *screen, ScreenBuffer *buffer)
 {
-  for(int row = 0; row <= screen->rows - 1; row++)
-    for(int col = 0; col <= screen->cols - 1; col++) {
-      ScreenCell *cell = &buffer[row * screen->cols + col];
-      if(VTERM_COLOR_IS_DEFAULT_FG(&cell->pen.fg))
-        cell->pen.fg = screen->pen.fg;
-      if(VTERM_COLOR_IS_DEFAULT_BG(&cell->pen.bg))
-        cell->pen.bg = screen->pen.bg;
-    }
+  for(int i = 0; i < screen->rows * screen->cols; i++) {
+    ScreenCell *cell = &buffer->cells[i];
+    if(VTERM_COLOR_IS_DEFAULT_FG(&cell->pen.fg))
+      cell->pen.fg = screen->pen.fg;
+    if(VTERM_COLOR_IS_DEFAULT_BG(&cell->pen.bg))
+      cell->pen.bg = screen->pen.bg;
+  }
 }
 
 void vterm_screen_set_default_colors(VTermScreen *screen, const VTermColor *default_fg, const VTermColor *default_bg)
@@ -28,6 +28,22 @@ static void putglyph(VTermState *state, const uint32_t chars[], int width, VTerm
   DEBUG_LOG("libvterm: Unhandled putglyph U+%04x at (%d,%d)\n", chars[0], pos.col, pos.row);
 }
 
+static int putglyphs(VTermState *state, const uint32_t chars[], int count, VTermPos pos)
+{
+  if(!state->callbacks_has_putglyphs || !state->callbacks || !state->callbacks->putglyphs)
+    return 0;
+
+  VTermGlyphRun run = {
+    .chars = chars,
+    .count = count,
+    .protected_cell = state->protected_cell,
+    .dwl = state->lineinfo[pos.row].doublewidth,
+    .dhl = state->lineinfo[pos.row].doubleheight,
+  };
+
+  return (*state->callbacks->putglyphs)(&run, pos, state->cbdata);
+}
+
 static void updatecursor(VTermState *state, VTermPos *oldpos, int cancel_phantom)
 {
   if(state->pos.col == oldpos->col && state->pos.row == oldpos->row)
@@ -74,6 +90,7 @@ static VTermState *vterm_state_new(VTerm *vt)
   state->callbacks = NULL;
   state->cbdata    = NULL;
   state->callbacks_has_premove = false;
+  state->callbacks_has_putglyphs = false;
 
   state->selection.callbacks = NULL;
   state->selection.user      = NULL;
@@ -297,6 +314,15 @@ static void set_lineinfo(VTermState *state, int row, int force, int dwl, int dhl
     state->lineinfo[row] = info;
 }
 
+/* True if codepoints[i] is a single-width glyph with no combining characters
+ * following it */
+static bool is_plain_glyph(const uint32_t codepoints[], int i, int npoints)
+{
+  if(i >= npoints || vterm_unicode_width(codepoints[i]) != 1)
+    return false;
+  return i + 1 == npoints || !vterm_unicode_is_combining(codepoints[i + 1]);
+}
+
 static int on_text(const char bytes[], size_t len, void *user)
 {
   VTermState *state = user;
@@ -309,8 +335,15 @@ static int on_text(const char bytes[], size_t len, void *user)
   int npoints = 0;
   size_t eaten = 0;
 
+  /* In UTF-8 mode G0 defaults to UTF-8 too. Decode both with the one instance,
+   * so a sequence split across writes continues whatever byte the next write
+   * starts with */
+  bool utf8_gl = state->vt->mode.utf8 &&
+                 state->encoding[state->gl_set].enc == state->encoding_utf8.enc;
+
   VTermEncodingInstance *encoding =
     state->gsingle_set     ? &state->encoding[state->gsingle_set] :
+    utf8_gl                ? &state->encoding_utf8 :
     !(bytes[eaten] & 0x80) ? &state->encoding[state->gl_set] :
     state->vt->mode.utf8   ? &state->encoding_utf8 :
                              &state->encoding[state->gr_set];
@@ -373,6 +406,46 @@ static int on_text(const char bytes[], size_t len, void *user)
   }
 
   for(; i < npoints; i++) {
+    /* Consecutive single-width glyphs with nothing combining onto them are
+     * placed as one run, up to the end of the line */
+    if(state->callbacks_has_putglyphs && !state->mode.insert &&
+       is_plain_glyph(codepoints, i, npoints)) {
+      if(state->at_phantom || state->pos.col + 1 > THISROWWIDTH(state)) {
+        linefeed(state);
+        state->pos.col = 0;
+        state->at_phantom = 0;
+        state->lineinfo[state->pos.row].continuation = 1;
+      }
+
+      int room = THISROWWIDTH(state) - state->pos.col;
+      int count = 1;
+      while(count < room && is_plain_glyph(codepoints, i + count, npoints))
+        count++;
+
+      if(count > 1 && putglyphs(state, codepoints + i, count, state->pos)) {
+        i += count - 1;
+        int last_col = state->pos.col + count - 1;
+
+        if(i == npoints - 1) {
+          /* End of the buffer; see below */
+          state->combine_chars[0] = codepoints[i];
+          state->combine_chars[1] = 0;
+          state->combine_width = 1;
+          state->combine_pos = (VTermPos){ .row = state->pos.row, .col = last_col };
+        }
+
+        if(last_col + 1 >= THISROWWIDTH(state)) {
+          state->pos.col = last_col;
+          if(state->mode.autowrap)
+            state->at_phantom = 1;
+        }
+        else {
+          state->pos.col = last_col + 1;
+        }
+        continue;
+      }
+    }
+
     // Try to find combining characters following this
     int glyph_starts = i;
     int glyph_ends;
@@ -862,6 +935,14 @@ static void set_dec_mode(VTermState *state, int num, int val)
     state->mode.bracketpaste = val;
     break;
 
+  case 2026:
+    // Synchronized output: the embedder holds presentation until it is reset.
+    // Stored only if the settermprop callback accepts it. DECRQM still answers 2
+    // (reset) when it was refused, so it does not tell an application whether
+    // the embedder honours the mode.
+    settermprop_bool(state, VTERM_PROP_SYNCHRONIZED, val);
+    break;
+
   default:
     DEBUG_LOG("libvterm: Unknown DEC mode %d\n", num);
     return;
@@ -937,6 +1018,10 @@ static void request_dec_mode(VTermState *state, int num)
       reply = state->mode.bracketpaste;
       break;
 
+    case 2026:
+      reply = state->mode.synchronized;
+      break;
+
     default:
       vterm_push_output_sprintf_ctrl(state->vt, C1_CSI, "?%d;%d$y", num, 0);
       return;
@@ -2115,6 +2200,10 @@ void vterm_state_reset(VTermState *state, int hard)
   state->mode.bracketpaste    = 0;
   state->mode.report_focus    = 0;
 
+  // End a pending synchronized update so the embedder does not keep waiting for it
+  if(state->mode.synchronized)
+    settermprop_bool(state, VTERM_PROP_SYNCHRONIZED, 0);
+
   state->mouse_flags = 0;
 
   state->vt->mode.ctrl8bit   = 0;
@@ -2189,6 +2278,11 @@ void vterm_state_callbacks_has_premove(VTermState *state)
   state->callbacks_has_premove = true;
 }
 
+void vterm_state_callbacks_has_putglyphs(VTermState *state)
+{
+  state->callbacks_has_putglyphs = true;
+}
+
 void *vterm_state_get_cbdata(VTermState *state)
 {
   return state->cbdata;
@@ -2261,6 +2355,9 @@ int vterm_state_set_termprop(VTermState *state, VTermProp prop, VTermValue *val)
   case VTERM_PROP_FOCUSREPORT:
     state->mode.report_focus = val->boolean;
     return 1;
+  case VTERM_PROP_SYNCHRONIZED:
+    state->mode.synchronized = val->boolean;
+    return 1;
 
   case VTERM_N_PROPS:
     return 0;
@@ -295,19 +295,33 @@ static int mk_wcwidth_cjk(uint32_t ucs)
 // ################################
 // ### The rest added by Paul Evans
 
-static const struct interval fullwidth[] = {
-#include "fullwidth.inc"
-};
+/* Width and combining flag for every codepoint up to U+10FFFF, looked up in
+ * two steps instead of searching the interval tables above. Regenerate with
+ * gen-width-table.pl whenever 'combining' or fullwidth.inc change.
+ */
+#include "widthtable.inc"
+
+#define WIDTH_TABLE_MAX 0x10FFFF
+
+static inline uint8_t width_entry(uint32_t codepoint)
+{
+  return width_blocks[width_index[codepoint >> WIDTH_TABLE_SHIFT]]
+                     [codepoint & ((1 << WIDTH_TABLE_SHIFT) - 1)];
+}
 
 INTERNAL int vterm_unicode_width(uint32_t codepoint)
 {
-  if(bisearch(codepoint, fullwidth, sizeof(fullwidth) / sizeof(fullwidth[0]) - 1))
-    return 2;
+  if(codepoint > WIDTH_TABLE_MAX)
+    return mk_wcwidth(codepoint);
 
-  return mk_wcwidth(codepoint);
+  int width = width_entry(codepoint) & 3;
+  return width == 3 ? -1 : width;
 }
 
 INTERNAL int vterm_unicode_is_combining(uint32_t codepoint)
 {
-  return bisearch(codepoint, combining, sizeof(combining) / sizeof(struct interval) - 1);
+  if(codepoint > WIDTH_TABLE_MAX)
+    return 0;
+
+  return (width_entry(codepoint) & 4) != 0;
 }
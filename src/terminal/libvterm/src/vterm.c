@@ -296,6 +296,7 @@ VTermValueType vterm_get_prop_type(VTermProp prop)
     case VTERM_PROP_CURSORSHAPE:   return VTERM_VALUETYPE_INT;
     case VTERM_PROP_MOUSE:         return VTERM_VALUETYPE_INT;
     case VTERM_PROP_FOCUSREPORT:   return VTERM_VALUETYPE_BOOL;
+    case VTERM_PROP_SYNCHRONIZED:  return VTERM_VALUETYPE_BOOL;
 
     case VTERM_N_PROPS: return 0;
   }
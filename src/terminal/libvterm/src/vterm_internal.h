@@ -11,6 +11,16 @@
 # define INTERNAL
 #endif
 
+/* Byte scanning in the parser and decoders works a vector at a time where the
+ * target has one; every user keeps a scalar fallback */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define VTERM_SIMD_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+# include <arm_neon.h>
+# define VTERM_SIMD_NEON
+#endif
+
 #ifdef DEBUG
 # define DEBUG_LOG(...) fprintf(stderr, __VA_ARGS__)
 #else
@@ -59,6 +69,7 @@ struct VTermState
   const VTermStateCallbacks *callbacks;
   void *cbdata;
   bool callbacks_has_premove;
+  bool callbacks_has_putglyphs;
 
   const VTermStateFallbacks *fallbacks;
   void *fbdata;
@@ -121,6 +132,7 @@ struct VTermState
     unsigned int leftrightmargin:1;
     unsigned int bracketpaste:1;
     unsigned int report_focus:1;
+    unsigned int synchronized:1;
   } mode;
 
   VTermEncodingInstance encoding[4], encoding_utf8;